@@ -4,6 +4,11 @@
 #include <regex>
 #include <sstream>
 #include <sys/stat.h>
+#include <vector>
+#ifdef OCL_RC_WITH_BINARIES
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -21,6 +26,149 @@ inline void ReplaceStringInPlace(std::string& subject, const std::string& search
 	}
 }
 
+/** FNV-1a, has to match oclHashSource of OpenCLTypes.h */
+inline unsigned long long hashSource(const std::string& source)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (char c : source)
+	{
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/** escapes a string for a C string literal */
+inline std::string escapeString(const std::string& str)
+{
+	std::string ret;
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			ret += '\\';
+		ret += c;
+	}
+	return ret;
+}
+
+typedef struct FCompiledBinary
+{
+	std::string deviceName;
+	std::string driverVersion;
+	std::vector<unsigned char> data;
+} FCompiledBinary;
+
+#ifdef OCL_RC_WITH_BINARIES
+std::string getDeviceString(cl_device_id device, cl_device_info info)
+{
+	size_t size = 0;
+	clGetDeviceInfo(device, info, 0, NULL, &size);
+	std::string ret(size, '\0');
+	clGetDeviceInfo(device, info, size, &ret[0], NULL);
+	return std::string(ret.c_str());
+}
+
+/** all GPUs of all platforms whose name contains one of the filters, every GPU if there is no filter */
+std::vector<cl_device_id> getTargetDevices(const std::vector<std::string>& filters)
+{
+	std::vector<cl_device_id> ret;
+	cl_uint platformCount = 0;
+	if (clGetPlatformIDs(0, NULL, &platformCount) != CL_SUCCESS || platformCount == 0)
+		return ret;
+
+	std::vector<cl_platform_id> platforms(platformCount);
+	clGetPlatformIDs(platformCount, platforms.data(), NULL);
+
+	for (cl_platform_id platform : platforms)
+	{
+		cl_uint deviceCount = 0;
+		if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &deviceCount) != CL_SUCCESS || deviceCount == 0)
+			continue;
+
+		std::vector<cl_device_id> devices(deviceCount);
+		clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, deviceCount, devices.data(), NULL);
+		for (cl_device_id device : devices)
+		{
+			std::string name = getDeviceString(device, CL_DEVICE_NAME);
+			bool selected = filters.empty();
+			for (const std::string& filter : filters)
+				selected |= name.find(filter) != std::string::npos;
+
+			if (selected)
+				ret.push_back(device);
+		}
+	}
+	return ret;
+}
+
+std::vector<FCompiledBinary> compileBinaries(const std::string& source, const std::vector<cl_device_id>& devices, const std::string& options)
+{
+	std::vector<FCompiledBinary> ret;
+	for (cl_device_id device : devices)
+	{
+		FCompiledBinary binary;
+		binary.deviceName = getDeviceString(device, CL_DEVICE_NAME);
+		binary.driverVersion = getDeviceString(device, CL_DRIVER_VERSION);
+
+		cl_int err = CL_SUCCESS;
+		cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+		if (err != CL_SUCCESS)
+			continue;
+
+		const char* src = source.c_str();
+		size_t length = source.size();
+		cl_program program = clCreateProgramWithSource(context, 1, &src, &length, &err);
+		if (err == CL_SUCCESS && clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL) == CL_SUCCESS)
+		{
+			size_t size = 0;
+			clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL);
+			binary.data.resize(size);
+			unsigned char* ptr = binary.data.data();
+			clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &ptr, NULL);
+			ret.push_back(binary);
+			std::cout << " Compiled binary for " << binary.deviceName << " (" << size << " bytes)\n";
+		}
+		else
+			std::cout << " Skipping binary for " << binary.deviceName << ": build failed\n";
+
+		if (program != NULL)
+			clReleaseProgram(program);
+		clReleaseContext(context);
+	}
+	return ret;
+}
+#endif
+
+/** writes the binaries of a source and get_<name>_binaries(), which is empty if nothing was compiled */
+void writeBinaries(std::fstream& file, const std::string& name, const std::vector<FCompiledBinary>& binaries, const std::string& options)
+{
+	for (size_t i = 0; i < binaries.size(); i++)
+	{
+		file << "inline constexpr unsigned char OCLRes_" << name << "_bin" << i << "[] = {";
+		const std::vector<unsigned char>& data = binaries[i].data;
+		for (size_t j = 0; j < data.size(); j++)
+			file << ((j % 32 == 0) ? "\n\t" : "") << (int)data[j] << ",";
+		file << "\n};\n";
+	}
+
+	if (binaries.empty())
+	{
+		file << "inline constexpr FOCLEmbeddedBinarySet get_" << name << "_binaries() { return { nullptr, 0, 0, \"\" }; }\n\n";
+		return;
+	}
+
+	file << "inline constexpr FOCLEmbeddedBinary OCLRes_" << name << "_binaries[] = {\n";
+	for (size_t i = 0; i < binaries.size(); i++)
+		file << "\t{ \"" << escapeString(binaries[i].deviceName) << "\", \"" << escapeString(binaries[i].driverVersion) << "\", OCLRes_" << name << "_bin" << i << ", sizeof(OCLRes_" << name << "_bin" << i << ") },\n";
+	file << "};\n";
+	file << "inline constexpr FOCLEmbeddedBinarySet get_" << name << "_binaries() { return { OCLRes_" << name << "_binaries, " << binaries.size() << ", OCLRes_" << name << "_hash, \"" << escapeString(options) << "\" }; }\n\n";
+}
+
+/**
+* OCL_RC [--binaries] [--device <name filter>]... [--options <build options>] <cl source dir> <include dir>
+* --binaries additionally compiles every source for the selected devices and embeds the binaries,
+* which needs OCL_RC to be built with OCL_RC_WITH_BINARIES
+*/
 int main(int argc, char *argv[])
 {
 	if (argc == 0)
@@ -29,6 +177,33 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
+	bool embedBinaries = false;
+	std::vector<std::string> deviceFilters;
+	std::string buildOptions;
+	for (int i = 1; i < argc - 2; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--binaries")
+			embedBinaries = true;
+		else if (arg == "--device" && i + 1 < argc - 2)
+			deviceFilters.push_back(argv[++i]);
+		else if (arg == "--options" && i + 1 < argc - 2)
+			buildOptions = argv[++i];
+	}
+
+#ifdef OCL_RC_WITH_BINARIES
+	std::vector<cl_device_id> devices;
+	if (embedBinaries)
+	{
+		devices = getTargetDevices(deviceFilters);
+		if (devices.empty())
+			std::cout << "No OpenCL device found, embedding sources only\n";
+	}
+#else
+	if (embedBinaries)
+		std::cout << "OCL_RC was built without OCL_RC_WITH_BINARIES, embedding sources only\n";
+#endif
+
 	struct stat info;
 
 	if(stat(argv[argc - 1], &info) != 0 || !(info.st_mode & S_IFDIR))
@@ -49,18 +224,17 @@ int main(int argc, char *argv[])
 	}
 
 	file << "#include <string>\n";
+	file << "#include <string_view>\n";
 	std::string basePath = std::string(argv[argc - 2])+"/";
 
 	for (auto& p : fs::directory_iterator(argv[argc - 2]))
 	{
 		if (p.is_directory())
 			continue;
-		std::wstring extw = p.path().extension().c_str();
-		std::string ext(extw.begin(), extw.end());
+		std::string ext = p.path().extension().string();
 		if (ext != ".cl")
 			continue;
-		std::wstring filenamew = p.path().filename().c_str();
-		std::string filename(filenamew.begin(), filenamew.end());
+		std::string filename = p.path().filename().string();
 
 		std::cout << "Processing: " << filename << '\n';
 
@@ -105,38 +279,36 @@ int main(int argc, char *argv[])
 		};
 
 		ReplaceStringInPlace(source, "\r\n", "\n");
-		ReplaceStringInPlace(source, "\n", "\\n");
-		ReplaceStringInPlace(source, "\"", "\\\"");
-		file << "inline std::string get_" << filename.substr(0, filename.size() - 3) << "() {\n\tstd::string ret;\n";
-		size_t i = 0;
-		size_t chunk = 100;
-		if (chunk < source.size())
-		{
-			while (i + chunk < source.size())
-			{
-				if (source[i + chunk - 1] == '\\')
-				{
-					int offset = 2;
-					while (source[i + chunk + offset - 1] == '\\')
-						offset += 2;
-					file << "\tret += \"" << source.substr(i, chunk + offset) << "\";\n";
-					i += chunk + offset;
-				}
-				else
-				{
-					std::string chunkstr = source.substr(i, chunk);
-					file << "\tret += \"" << chunkstr << "\";\n";
-					i += chunk;
-				}
-			}
-			if (i < source.size())
-				file << "\tret += \"" << source.substr(i, source.size() - i) << "\";\n";
-		}
-		else
-		{
-			file << "\tret += \"" << source << "\";\n";
-		}
-		file << "\treturn ret;\n}\n\n";
+		std::string name = filename.substr(0, filename.size() - 3);
+
+		//the raw string delimiter must not occur in the source
+		std::string delimiter = "OCLRC";
+		while (source.find(")" + delimiter + "\"") != std::string::npos)
+			delimiter += "_";
+
+		file << "inline constexpr std::string_view OCLRes_" << name << " =\n";
+		if (source.empty())
+			file << "\t\"\"\n";
+
+		//MSVC limits the length of a single string literal, adjacent literals are concatenated
+		size_t chunk = 4096;
+		for (size_t i = 0; i < source.size(); i += chunk)
+			file << "\tR\"" << delimiter << "(" << source.substr(i, chunk) << ")" << delimiter << "\"\n";
+
+		file << ";\n";
+		file << "inline constexpr unsigned long long OCLRes_" << name << "_hash = " << hashSource(source) << "ULL;\n";
+		file << "inline constexpr std::string_view get_" << name << "() { return OCLRes_" << name << "; }\n";
+		file << "inline constexpr unsigned long long get_" << name << "_hash() { return OCLRes_" << name << "_hash; }\n";
+
+		std::vector<FCompiledBinary> binaries;
+#ifdef OCL_RC_WITH_BINARIES
+		//sources with dynamic constants can only be compiled after specialization at runtime
+		if (!devices.empty() && std::regex_search(source, std::regex("%\\w+%")))
+			std::cout << " Skipping binaries: source has dynamic constants\n";
+		else if (!devices.empty())
+			binaries = compileBinaries(source, devices, buildOptions);
+#endif
+		writeBinaries(file, name, binaries, buildOptions);
 		file.flush();
 	}
 	file.close();
@@ -0,0 +1,61 @@
+#pragma once
+#include "OpenCLExecutor.h"
+#include <memory>
+
+enum EOCLCommandType
+{
+	CTUpload,
+	CTLaunch,
+	CTDownload
+};
+
+/**
+* Record once, replay many sequence of uploads, kernel launches and downloads on a private in order queue.
+* Launches are validated, initialized and get their local range when recorded. Every launch owns a cl::Kernel
+* with its arguments already set, a replay only rebinds arguments whose memory object or value changed.
+* The recorded kernels and variables are referenced and have to outlive the list
+*/
+class OCLCommandList
+{
+public:
+	OCLCommandList(OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLCommandList();
+
+	OCLCommandList(const OCLCommandList&) = delete;
+
+	/** uploads var on every replay, even if it is not marked as changed */
+	OCLCommandList& upload(OCLVariable* var);
+	/** launches kernel with its current global and local range, changed arguments are uploaded first like RunKernel does */
+	OCLCommandList& launch(FOCLKernel& kernel);
+	OCLCommandList& download(OCLVariable* var);
+
+	/**
+	* Enqueues the recorded commands and flushes once
+	* @Param waitForCompletion blocks until the commands finished, otherwise wait for the returned event
+	*/
+	cl::Event replay(bool waitForCompletion = true);
+	void clear();
+	size_t size() { return commands.size(); };
+	/** arguments set again by the last replay because they changed */
+	size_t getRebindCount() { return rebindCount; };
+
+protected:
+	typedef struct FOCLRecordedCommand
+	{
+		EOCLCommandType type;
+		OCLVariable* var = NULL;
+		/** child group on the list queue holding the private kernel of a launch */
+		std::shared_ptr<FOCLKernelGroup> group;
+		/** bound cl_mem of every argument, NULL for values */
+		std::vector<cl_mem> boundMemory;
+		std::vector<std::vector<char>> boundValues;
+	} FOCLRecordedCommand;
+
+	void bindArguments(FOCLRecordedCommand& command, bool force);
+
+	OpenCLExecutor& executor;
+	cl::Context context;
+	cl::CommandQueue queue;
+	std::vector<FOCLRecordedCommand> commands;
+	size_t rebindCount = 0;
+};
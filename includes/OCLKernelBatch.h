@@ -0,0 +1,34 @@
+#pragma once
+#include "OpenCLExecutor.h"
+
+/** Records kernel launches and result downloads and submits them together with OpenCLExecutor::RunBatch.
+    The recorded kernels and variables are referenced, they have to outlive submit */
+class OCLKernelBatch
+{
+public:
+	OCLKernelBatch(OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLKernelBatch();
+
+	/** launches kernel after all launches recorded before, its arguments are uploaded first if they changed */
+	OCLKernelBatch& add(FOCLKernel& kernel);
+	/** reads var back after all launches of the batch */
+	OCLKernelBatch& download(OCLVariable* var);
+
+	/**
+	* Submits all recorded commands with one flush, the recording is kept for further submits
+	* @Param waitForCompletion blocks until the batch finished
+	* @Returns event completing after the last command
+	*/
+	cl::Event submit(const VECTOR_CLASS<cl::Event>* events = NULL, bool waitForCompletion = true);
+	/** waits for the last submit */
+	void wait();
+	void clear();
+	size_t size() { return kernels.size(); };
+
+protected:
+	OpenCLExecutor& executor;
+	std::vector<FOCLKernel*> kernels;
+	std::vector<OCLVariable*> downloads;
+	cl::Event lastSubmit;
+	bool bHasSubmitted = false;
+};
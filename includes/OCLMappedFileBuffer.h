@@ -0,0 +1,300 @@
+#pragma once
+#include "OpenCLTypes.h"
+#include <string.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+enum EOCLFileMapMode
+{
+	FMReadOnly,
+	FMCopyOnWrite
+};
+
+enum EOCLFileAccessHint
+{
+	FAHNormal,
+	FAHSequential,
+	FAHRandom
+};
+
+/** Maps a recorded data file into memory and uploads windows of it directly from the mapping.
+    The device buffer is only as large as the window, so files larger than the device memory can be replayed window by window. */
+template<typename T>
+class OCLMappedFileBuffer : public OCLVariable
+{
+protected:
+	std::string path;
+	EOCLFileMapMode mapMode;
+	EOCLFileAccessHint accessHint = FAHNormal;
+	T* mapping = NULL;
+	size_t mappedBytes = 0;
+	size_t elementCount = 0;
+	size_t windowStart = 0;
+	size_t windowLength = 0;
+	size_t windowCapacity = 0;
+	size_t replayPos = 0;
+	cl::Buffer* memoryBuffer = NULL;
+#ifdef WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+	HANDLE mappingHandle = NULL;
+#else
+	int fileHandle = -1;
+#endif
+
+public:
+	/** @param windowLength amount of elements uploaded at once, 0 uploads the whole file */
+	OCLMappedFileBuffer(std::string path, EOCLFileMapMode mode = FMReadOnly, size_t windowLength = 0, std::string name = "", bool bIsBlocking = true, EOCLAccessTypes accessType = EOCLAccessTypes::ATRead) : OCLVariable(name, bIsBlocking, accessType)
+	{
+		this->path = path;
+		this->mapMode = mode;
+		//the destructor does not run for a throwing constructor, the handles opened so far are closed here
+		try
+		{
+			mapFile();
+		}
+		catch (...)
+		{
+			unmapFile();
+			throw;
+		}
+
+		if (windowLength == 0 || windowLength > elementCount)
+			windowLength = elementCount;
+
+		this->windowCapacity = windowLength;
+		this->windowLength = windowLength;
+	}
+
+	OCLMappedFileBuffer(const OCLMappedFileBuffer<T>& var) = delete;
+
+	virtual ~OCLMappedFileBuffer() override
+	{
+		this->releaseTracking();
+		if (this->memoryBuffer != NULL)
+			delete this->memoryBuffer;
+
+		unmapFile();
+	}
+
+	virtual void* getValue() override { return this->mapping + this->windowStart; };
+	virtual void  setValue(void* val) override
+	{
+		if (mapMode == FMReadOnly)
+			throw OCLException("Trying to write into read only file mapping!");
+
+		memcpy(getValue(), val, windowLength * sizeof(T));
+		this->bisUploaded = false;
+	};
+	virtual size_t getTypeSize() override { return sizeof(T); };
+	/** size of the device buffer, which is the size of the largest window */
+	virtual size_t getSize() override { return windowCapacity * sizeof(T); };
+	/** size of the current window, the last window of a file may be shorter than the device buffer */
+	virtual size_t getAvailableData() override { return windowLength * sizeof(T); };
+	virtual EOCLBufferType getBufferType() override { return EOCLBufferType::BTNative; };
+	T* getTypedValue() { return (T*)getValue(); };
+	operator OCLVariable*() const { return (OCLVariable*)this; };
+	/** index relative to the current window */
+	virtual T& operator[](size_t i) { return this->mapping[this->windowStart + i]; };
+
+	size_t getBufferLength() { return this->windowLength; }
+	size_t getFileLength() { return this->elementCount; }
+	size_t getWindowStart() { return this->windowStart; }
+	EOCLFileMapMode getMapMode() { return this->mapMode; }
+
+	/** Moves the window onto the elements [firstElement, firstElement + length)
+	    The device buffer grows if length exceeds the current window capacity */
+	void setWindow(size_t firstElement, size_t length)
+	{
+		if (firstElement > elementCount)
+			throw OCLException("Window starts behind the end of file: " + path);
+
+		if (firstElement + length > elementCount)
+			length = elementCount - firstElement;
+
+		if (length > windowCapacity)
+		{
+			this->releaseManagedBuffer(this->memoryBuffer);
+			windowCapacity = length;
+		}
+
+		if (accessHint == FAHSequential && mapMode == FMReadOnly && firstElement > windowStart)
+			adviseRange(windowStart, firstElement - windowStart, false);
+
+		windowStart = firstElement;
+		windowLength = length;
+		this->bisUploaded = false;
+
+		if (accessHint == FAHSequential)
+			adviseRange(windowStart + windowLength, windowCapacity, true);
+	}
+
+	/** Moves to the next window of the same size
+	    @Returns false if the end of the file is reached */
+	bool advanceWindow()
+	{
+		if (windowStart + windowLength >= elementCount)
+			return false;
+
+		setWindow(windowStart + windowLength, windowCapacity);
+		return true;
+	}
+
+	/** Sets the readahead behaviour of the mapping. Sequential replay prefetches the following window and drops pages behind the current one */
+	void setAccessHint(EOCLFileAccessHint hint)
+	{
+		accessHint = hint;
+#ifndef WIN32
+		int advice = MADV_NORMAL;
+		if (hint == FAHSequential)
+			advice = MADV_SEQUENTIAL;
+		else if (hint == FAHRandom)
+			advice = MADV_RANDOM;
+
+		if (mapping != NULL)
+			madvise(mapping, mappedBytes, advice);
+#endif
+		if (hint == FAHSequential)
+			adviseRange(windowStart, windowLength + windowCapacity, true);
+	}
+
+	/** Writes up to count elements from the replay position into the ring and publishes them for the next upload
+	    @Returns the amount of elements written */
+	template<size_t size, EOCLArgumentScope TScope>
+	size_t replayInto(OCLTypedRingBuffer<T, size, TScope>& ring, size_t count)
+	{
+		if (replayPos + count > elementCount)
+			count = elementCount - replayPos;
+
+		for (size_t i = 0; i < count; i++)
+			ring.writeNext(mapping[replayPos + i]);
+
+		replayPos += count;
+		ring.setReadEndPosForCLDevice(ring.getWriteIndex());
+
+		if (accessHint == FAHSequential)
+			adviseRange(replayPos, count, true);
+
+		return count;
+	}
+
+	void setReplayPosition(size_t pos) { replayPos = (pos > elementCount) ? elementCount : pos; }
+	size_t getReplayPosition() { return replayPos; }
+
+	virtual cl_int downloadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true) override
+	{
+		if (this->getCLMemoryObject(NULL) == NULL || mapMode == FMReadOnly)
+			return CL_SUCCESS;
+
+		if (this->getAccessType() == EOCLAccessTypes::ATWrite || this->getAccessType() == EOCLAccessTypes::ATReadWrite)
+			return queue->enqueueReadBuffer(*this->memoryBuffer, this->getTransferBlocking(bAllowBlocking), 0, this->getAvailableData(), this->getValue());
+
+		return CL_SUCCESS;
+	}
+
+	virtual cl::Memory* getCLMemoryObject(cl::Context* context) override
+	{
+		if (context == NULL)
+			return this->memoryBuffer;
+
+		if (this->memoryBuffer == NULL && windowCapacity > 0)
+			this->memoryBuffer = this->createManagedBuffer(context, getSize());
+		else if (this->memoryBuffer != NULL)
+			this->touchCLMemory();
+
+		return this->memoryBuffer;
+	};
+
+protected:
+	virtual void dropCLMemory() override
+	{
+		delete this->memoryBuffer;
+		this->memoryBuffer = NULL;
+	}
+
+	void mapFile()
+	{
+#ifdef WIN32
+		DWORD access = GENERIC_READ;
+		fileHandle = CreateFileA(path.c_str(), access, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			throw OCLException("Could not open file: " + path);
+
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(fileHandle, &fileSize);
+		mappedBytes = (size_t)fileSize.QuadPart;
+		if (mappedBytes == 0)
+			return;
+
+		mappingHandle = CreateFileMappingA(fileHandle, NULL, (mapMode == FMReadOnly) ? PAGE_READONLY : PAGE_WRITECOPY, 0, 0, NULL);
+		if (mappingHandle == NULL)
+			throw OCLException("Could not map file: " + path);
+
+		mapping = (T*)MapViewOfFile(mappingHandle, (mapMode == FMReadOnly) ? FILE_MAP_READ : FILE_MAP_COPY, 0, 0, 0);
+#else
+		fileHandle = open(path.c_str(), O_RDONLY);
+		if (fileHandle < 0)
+			throw OCLException("Could not open file: " + path);
+
+		struct stat info;
+		fstat(fileHandle, &info);
+		mappedBytes = (size_t)info.st_size;
+		if (mappedBytes == 0)
+			return;
+
+		int prot = (mapMode == FMReadOnly) ? PROT_READ : (PROT_READ | PROT_WRITE);
+		void* ptr = mmap(NULL, mappedBytes, prot, MAP_PRIVATE, fileHandle, 0);
+		mapping = (ptr == MAP_FAILED) ? NULL : (T*)ptr;
+#endif
+		if (mapping == NULL)
+			throw OCLException("Could not map file: " + path);
+
+		elementCount = mappedBytes / sizeof(T);
+	}
+
+	void unmapFile()
+	{
+#ifdef WIN32
+		if (mapping != NULL)
+			UnmapViewOfFile(mapping);
+		if (mappingHandle != NULL)
+			CloseHandle(mappingHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(fileHandle);
+		mappingHandle = NULL;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (mapping != NULL)
+			munmap(mapping, mappedBytes);
+		if (fileHandle >= 0)
+			close(fileHandle);
+		fileHandle = -1;
+#endif
+		mapping = NULL;
+	}
+
+	/** prefetches (willNeed) or drops the pages of the given element range */
+	void adviseRange(size_t firstElement, size_t length, bool willNeed)
+	{
+#ifndef WIN32
+		if (mapping == NULL || firstElement >= elementCount || length == 0)
+			return;
+
+		if (firstElement + length > elementCount)
+			length = elementCount - firstElement;
+
+		size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		size_t begin = firstElement * sizeof(T);
+		size_t end = (firstElement + length) * sizeof(T);
+		size_t alignedBegin = begin - (begin % pageSize);
+		if (!willNeed)
+			end -= end % pageSize;
+		if (end <= alignedBegin)
+			return;
+
+		madvise((char*)mapping + alignedBegin, end - alignedBegin, willNeed ? MADV_WILLNEED : MADV_DONTNEED);
+#endif
+	}
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include "OpenCLTypes.h"
+#include "opencv2/core.hpp"
+
+/** throws OCLException if the pixels of mat don't have the size of the pixels of the image of var */
+template<typename TMem>
+void oclCheckMatFormat(OCLMemoryVariable<TMem>& var, const cv::Mat& mat)
+{
+	size_t elementSize = var.getImageElementSize();
+	if (mat.elemSize() != elementSize)
+		throw OCLException("cv::Mat pixels of " + std::to_string(mat.elemSize()) + " bytes don't match the image " + var.getName()
+			+ " with pixels of " + std::to_string(elementSize) + " bytes");
+}
+
+/** writes mat to the image at x, y. Submatrices are transferred row by row with their step, without a copy */
+template<typename TMem>
+cl_int oclWriteMat(cl::CommandQueue* queue, OCLMemoryVariable<TMem>& var, const cv::Mat& mat, size_t x = 0, size_t y = 0, bool blocking = true)
+{
+	oclCheckMatFormat(var, mat);
+	return var.writeRegion(queue, x, y, mat.cols, mat.rows, mat.data, mat.step[0], blocking);
+}
+
+/** reads the region of the image at x, y with the size of mat into mat, e.g. into a submatrix of a larger cv::Mat */
+template<typename TMem>
+cl_int oclReadMat(cl::CommandQueue* queue, OCLMemoryVariable<TMem>& var, cv::Mat& mat, size_t x = 0, size_t y = 0, bool blocking = true)
+{
+	if (mat.empty())
+		throw OCLException("cv::Mat to read the image " + var.getName() + " into is not allocated");
+
+	oclCheckMatFormat(var, mat);
+	return var.readRegion(queue, x, y, mat.cols, mat.rows, mat.data, mat.step[0], blocking);
+}
+
+/** reads roi of the image into a new cv::Mat of type */
+template<typename TMem>
+cv::Mat oclReadMatRegion(cl::CommandQueue* queue, OCLMemoryVariable<TMem>& var, const cv::Rect& roi, int type)
+{
+	cv::Mat ret(roi.height, roi.width, type);
+	cl_int err = oclReadMat(queue, var, ret, roi.x, roi.y, true);
+	if (CL_SUCCESS != err)
+		throw OCLException("CL ERROR: could not read image region of " + var.getName() + " [" + clDecodeErrorCode(err) + "]");
+	return ret;
+}
+
+/**
+* Uses mat as host memory of the image at x, y for the uploads and downloads of kernel launches. Only the region of mat is transferred.
+* mat has to stay allocated while var uses it
+*/
+template<typename TMem>
+void oclBindMat(OCLMemoryVariable<TMem>& var, cv::Mat& mat, size_t x = 0, size_t y = 0)
+{
+	oclCheckMatFormat(var, mat);
+	var.setHostPointer(mat.data);
+	var.setRegion(x, y, mat.cols, mat.rows, mat.step[0]);
+}
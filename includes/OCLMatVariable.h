@@ -0,0 +1,69 @@
+#pragma once
+#include "OpenCLTypes.h"
+#include "opencv2/core.hpp"
+
+/** device memory an OCLMatVariable binds its cv::Mat to */
+enum EOCLMatBinding
+{
+	MBBuffer,
+	MBImage
+};
+
+/**
+* Kernel argument bound to a cv::Mat, as buffer or 2D image with format, size and row pitch taken from the Mat.
+* On devices with host unified memory the device uses the memory of the Mat (CL_MEM_USE_HOST_PTR) and transfers only map it,
+* other devices get pinned memory (CL_MEM_ALLOC_HOST_PTR) the rows of the Mat are copied to through a mapping.
+* The variable holds a reference to the Mat, its memory stays valid until no launch uses the variable anymore
+*/
+class OCLMatVariable : public OCLVariable
+{
+public:
+	OCLMatVariable(cv::Mat mat, std::string name = "", EOCLMatBinding binding = MBBuffer, bool bIsBlocking = true, EOCLAccessTypes accessType = ATReadWrite);
+	/** the buffer of umat is passed to kernels directly if OpenCV uses the context of the launch, otherwise the Mat of UMat::getMat is bound */
+	OCLMatVariable(cv::UMat umat, std::string name = "", bool bIsBlocking = true, EOCLAccessTypes accessType = ATReadWrite);
+	/** waits for the launches using the Mat */
+	virtual ~OCLMatVariable();
+
+	OCLMatVariable(const OCLMatVariable&) = delete;
+
+	cv::Mat& getMat() { return mat; };
+	/** bytes between the rows, buffer kernels need it to index submatrices */
+	size_t getRowPitch() { return mat.step[0]; };
+	/** true if the device works on the memory of the Mat or UMat without copies, known after the first launch */
+	bool isZeroCopy() { return bIsZeroCopy; };
+	/** image format of a Mat type, throws OCLException for types without one */
+	static cl::ImageFormat getImageFormat(int type);
+
+	virtual void* getValue() override { return mat.data; };
+	/** throws OCLException, bind another Mat with a new variable */
+	virtual void setValue(void* val) override;
+	virtual size_t getTypeSize() override { return mat.elemSize(); };
+	/** bytes from the first to the last pixel, including the padding of all rows but the last */
+	virtual size_t getSize() override;
+	virtual EOCLBufferType getBufferType() override { return (binding == MBImage) ? BTCLImage : BTCLMem; };
+	virtual cl::Memory* getCLMemoryObject(cl::Context* context) override;
+	/** without bAllowBlocking the Mat is written directly instead of through a blocking mapping */
+	virtual cl_int uploadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true) override;
+	/** without bAllowBlocking the rows are read into the Mat without waiting, see uploadBuffer */
+	virtual cl_int downloadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true) override;
+	/** the memory belongs to the Mat and is never evicted */
+	virtual bool isEvictable() override { return false; };
+
+protected:
+	/** creates the device memory on the first use in context */
+	void createMemory(cl::Context* context);
+	/** @Returns false if the UMat buffer can't be used in context */
+	bool bindUMatBuffer(cl::Context* context);
+	/** maps the device memory and copies the rows of the Mat to or from it unless the mapping is the Mat itself */
+	cl_int syncThroughMapping(cl::CommandQueue* queue, bool toDevice);
+	/** enqueues a read or write between the device memory and the Mat with its row pitch without waiting */
+	cl_int enqueueTransfer(cl::CommandQueue* queue, bool toDevice);
+
+	cv::Mat mat;
+	cv::UMat umat;
+	bool bHasUMat = false;
+	EOCLMatBinding binding;
+	cl::Memory* memory = NULL;
+	cl_context memoryContext = NULL;
+	bool bIsZeroCopy = false;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include "OpenCLTypes.h"
+#include <mutex>
+#include <map>
+#include <atomic>
+#include <functional>
+
+typedef struct FOCLMemoryStats
+{
+	/** 0 until OpenCLExecutor::InitPlatform sets it, see setDefaultBudget */
+	size_t budget = 0;
+	size_t allocated = 0;
+	size_t peakAllocated = 0;
+	/** amount of tracked device allocations */
+	size_t allocationCount = 0;
+	size_t evictionCount = 0;
+	size_t evictedBytes = 0;
+} FOCLMemoryStats;
+
+/**
+* Accounts the device buffers of the variables of one context against a budget, every context has its own manager.
+* If a new buffer does not fit, the least recently used evictable variables are evicted: data the device wrote is read back
+* to the host, the buffer is deleted and the variable is uploaded again by the next launch using it.
+* Buffers of the launch in progress and memory the variables do not own (OCLMemoryVariable) are never evicted
+*/
+class OCLMemoryManager
+{
+public:
+	/** manager of context, created on first use */
+	static std::shared_ptr<OCLMemoryManager> getManager(cl::Context* context);
+	/** removes the manager of context, variables still holding buffers of it keep it alive */
+	static void releaseManager(cl::Context* context);
+	/** budget OpenCLExecutor::InitPlatform sets for its context, 0 uses the global memory of the device */
+	static void setDefaultBudget(size_t bytes);
+	static size_t getDefaultBudget();
+	/** use stamps are shared by all managers */
+	static unsigned long long nextUse() { return ++useClock; };
+
+	OCLMemoryManager(const OCLMemoryManager&) = delete;
+	~OCLMemoryManager();
+
+	void setBudget(size_t bytes);
+	size_t getBudget();
+	FOCLMemoryStats getStats();
+	/** called before data of an evicted variable is read back, has to wait until no launch writes device memory of the context anymore */
+	void setSyncCallback(std::function<void()> callback);
+
+	/**
+	* Evicts variables until bytes more fit into the budget
+	* @Returns false if not enough memory could be freed
+	*/
+	bool makeRoom(size_t bytes, OCLVariable* requester = NULL);
+	/** evicts every evictable variable not used by the current launch, @Returns the freed bytes */
+	size_t evictAll();
+
+	void track(OCLVariable* var, size_t bytes, bool evictable);
+	void forget(OCLVariable* var);
+	void beginEpoch() { launchEpoch = useClock.load(); };
+
+protected:
+	OCLMemoryManager(const cl::Context& context);
+
+	typedef struct FOCLTrackedMemory
+	{
+		size_t bytes = 0;
+		bool bEvictable = true;
+	} FOCLTrackedMemory;
+
+	/** least recently used evictable variable, NULL if there is none. Requires lock */
+	OCLVariable* findVictim(OCLVariable* requester);
+	/** Requires lock */
+	size_t evict(OCLVariable* var, bool& synced);
+	cl::CommandQueue* getQueue();
+
+	cl::Context context;
+	std::mutex lock;
+	std::map<OCLVariable*, FOCLTrackedMemory> tracked;
+	FOCLMemoryStats stats;
+	std::function<void()> syncCallback;
+	cl::CommandQueue* queue = NULL;
+	std::atomic<unsigned long long> launchEpoch;
+
+	static std::atomic<unsigned long long> useClock;
+	static std::atomic<size_t> defaultBudget;
+};
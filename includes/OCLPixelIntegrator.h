@@ -0,0 +1,68 @@
+#pragma once
+#include "OpenCLExecutor.h"
+#include "OCLTpxPixel.h"
+
+#include <chrono>
+
+/** integration time of one build profile, see OCLPixelIntegrator::benchmarkProfiles */
+typedef struct FOCLProfileBenchmark
+{
+	EOCLBuildProfile profile = BPStandard;
+	std::string buildOptions;
+	double milliseconds = 0;
+	/** the image equals the one of the first benchmarked profile */
+	bool bMatchesReference = true;
+} FOCLProfileBenchmark;
+
+/** Integrates Timepix hits of a ToA window into a 2D count image on the CL device.
+    Sliding windows are updated incrementally by adding the newly covered and subtracting the expired time ranges. */
+class OCLPixelIntegrator
+{
+public:
+	OCLPixelIntegrator(int width = 256, int height = 256, bool weightByToT = false, OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLPixelIntegrator();
+
+	/** clears the image and integrates all hits with ToA in [startTime, endTime)
+	    @param hitCount amount of FTpxPixel in hits, 0 uses the whole buffer */
+	void integrate(OCLVariable* hits, cl_ulong startTime, cl_ulong endTime, size_t hitCount = 0);
+	/** moves the window to [startTime, endTime). hits has to contain the expired and the newly covered hits */
+	void slideWindow(OCLVariable* hits, cl_ulong startTime, cl_ulong endTime, size_t hitCount = 0);
+	void reset();
+	void setWeightByToT(bool val);
+	/** rebuilds the integration kernel with the given profile on the next run */
+	void setBuildProfile(EOCLBuildProfile profile);
+	/** integrates [startTime, endTime) repetitions times with every build profile. The image is reset afterwards */
+	std::vector<FOCLProfileBenchmark> benchmarkProfiles(OCLVariable* hits, cl_ulong startTime, cl_ulong endTime, size_t hitCount = 0, int repetitions = 10);
+	/** @param download reads the current image back from the CL device */
+	OCLDynamicTypedBuffer<cl_int>& getImage(bool download = true);
+
+	inline cl_ulong getWindowStart() { return windowStart; };
+	inline cl_ulong getWindowEnd() { return windowEnd; };
+
+protected:
+	void runIntegration(OCLVariable* hits, size_t hitCount, cl_ulong addFrom, cl_ulong addTo, cl_ulong subFrom, cl_ulong subTo);
+
+	OpenCLExecutor& executor;
+	FOCLKernel integrationKernel;
+	OCLDynamicTypedBuffer<cl_int> image;
+	OCLTypedVariable<cl_ulong, ASPrivate> hitCountArg;
+	OCLTypedVariable<cl_ulong, ASPrivate> addFromArg;
+	OCLTypedVariable<cl_ulong, ASPrivate> addToArg;
+	OCLTypedVariable<cl_ulong, ASPrivate> subFromArg;
+	OCLTypedVariable<cl_ulong, ASPrivate> subToArg;
+	OCLTypedVariable<cl_int, ASPrivate> useToTArg;
+	OCLTypedVariable<cl_int, ASPrivate> widthArg;
+	OCLTypedVariable<cl_int, ASPrivate> heightArg;
+	size_t workGroupSize = 0;
+	size_t groupsPerTile = 0;
+	size_t tileCount = 0;
+	cl_ulong windowStart = 0;
+	cl_ulong windowEnd = 0;
+	bool bHasWindow = false;
+
+	/** edge of the square tiles histogrammed in local memory, chosen from the local memory of the device */
+	int tileSize = 0;
+
+	static const int MaxTileSize = 64;
+	static const int MinTileSize = 16;
+};
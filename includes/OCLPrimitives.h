@@ -0,0 +1,138 @@
+#pragma once
+#include "OpenCLExecutor.h"
+#include <map>
+#include <chrono>
+
+enum EOCLReduceOp
+{
+	ROSum = 0,
+	ROMin = 1,
+	ROMax = 2
+};
+
+typedef struct FOCLPrimitiveBenchmark
+{
+	double reduceMilliseconds = 0;
+	double minMaxMilliseconds = 0;
+	double scanMilliseconds = 0;
+	double histogramMilliseconds = 0;
+	double compactMilliseconds = 0;
+} FOCLPrimitiveBenchmark;
+
+/** Type generic parallel primitives for OCLDynamicTypedBuffers.
+    The kernels of Primitives.cl are specialized per element type on first use.
+    Outputs stay on the CL device, use downloadResult to read them back */
+class OCLPrimitives
+{
+public:
+	OCLPrimitives(OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLPrimitives();
+
+	/** @param count 0 uses the whole buffer */
+	template<typename T>
+	T reduce(OCLDynamicTypedBuffer<T>& in, EOCLReduceOp op = ROSum, size_t count = 0)
+	{
+		OCLDynamicTypedBuffer<T> result(NULL, 1, "reduceResult");
+		runReduce(&in, &result, FOCLTypeInfo<T>::get(), op, (count == 0) ? in.getBufferLength() : count);
+		return result[0];
+	}
+
+	template<typename T>
+	T minimum(OCLDynamicTypedBuffer<T>& in, size_t count = 0) { return reduce(in, ROMin, count); }
+
+	template<typename T>
+	T maximum(OCLDynamicTypedBuffer<T>& in, size_t count = 0) { return reduce(in, ROMax, count); }
+
+	/** in and out may be the same buffer */
+	template<typename T>
+	void scan(OCLDynamicTypedBuffer<T>& in, OCLDynamicTypedBuffer<T>& out, bool inclusive = true, size_t count = 0)
+	{
+		if (count == 0)
+			count = in.getBufferLength();
+		if (out.getBufferLength() < count)
+			out.resizeBuffer(count);
+		if (&in != &out)
+			out.setVariableChanged(false);
+
+		runScan(&in, &out, FOCLTypeInfo<T>::get(), inclusive, count);
+	}
+
+	/** counts the values of [minValue, maxValue] into bins.getBufferLength() equally sized bins, the bins are cleared before */
+	template<typename T>
+	void histogram(OCLDynamicTypedBuffer<T>& in, OCLDynamicTypedBuffer<cl_uint>& bins, T minValue, T maxValue, size_t count = 0)
+	{
+		OCLTypedVariable<T, ASPrivate> minArg(minValue, "minValue");
+		OCLTypedVariable<T, ASPrivate> maxArg(maxValue, "maxValue");
+		runHistogram(&in, &bins, &minArg, &maxArg, FOCLTypeInfo<T>::get(), (count == 0) ? in.getBufferLength() : count);
+	}
+
+	/** copies all values matching the predicate in order into out
+	    @param predicate OpenCL C expression on the value x, e.g. "x > 0"
+	    @Returns the amount of copied values */
+	template<typename T>
+	size_t compact(OCLDynamicTypedBuffer<T>& in, OCLDynamicTypedBuffer<T>& out, std::string predicate, size_t count = 0)
+	{
+		if (count == 0)
+			count = in.getBufferLength();
+		if (out.getBufferLength() < count)
+			out.resizeBuffer(count);
+		out.setVariableChanged(false);
+
+		return runCompact(&in, &out, FOCLTypeInfo<T>::get(), predicate, count);
+	}
+
+	/** times every primitive on the given input */
+	template<typename T>
+	FOCLPrimitiveBenchmark benchmark(OCLDynamicTypedBuffer<T>& in, int repetitions = 10)
+	{
+		FOCLPrimitiveBenchmark result;
+		OCLDynamicTypedBuffer<T> out(NULL, in.getBufferLength(), "benchmarkOut");
+		OCLDynamicTypedBuffer<cl_uint> bins(NULL, 256, "benchmarkBins");
+		T lowest = minimum(in);
+		T highest = maximum(in);
+
+		result.reduceMilliseconds = timeRepeated(repetitions, [&]() { reduce(in); });
+		result.minMaxMilliseconds = timeRepeated(repetitions, [&]() { minimum(in); maximum(in); });
+		result.scanMilliseconds = timeRepeated(repetitions, [&]() { scan(in, out); });
+		result.histogramMilliseconds = timeRepeated(repetitions, [&]() { histogram(in, bins, lowest, highest); });
+		result.compactMilliseconds = timeRepeated(repetitions, [&]() { compact(in, out, "x != 0"); });
+
+		return result;
+	}
+
+	/** reads an output of the last primitive back into host memory */
+	bool downloadResult(OCLVariable* var);
+
+protected:
+	FOCLKernel& getKernel(const std::string& mainMethodName, const FOCLTypeDesc& type, EOCLReduceOp op = ROSum, size_t localBins = 0, const std::string& predicate = "1");
+	void runReduce(OCLVariable* in, OCLVariable* result, const FOCLTypeDesc& type, EOCLReduceOp op, size_t count);
+	void runScan(OCLVariable* in, OCLVariable* out, const FOCLTypeDesc& type, bool inclusive, size_t count, size_t level = 0);
+	void runHistogram(OCLVariable* in, OCLDynamicTypedBuffer<cl_uint>* bins, OCLVariable* minValue, OCLVariable* maxValue, const FOCLTypeDesc& type, size_t count);
+	size_t runCompact(OCLVariable* in, OCLVariable* out, const FOCLTypeDesc& type, const std::string& predicate, size_t count);
+	/** device only scratch buffer, grows on demand */
+	OCLDynamicTypedBuffer<cl_uchar>* getScratch(size_t idx, size_t bytes);
+
+	template<typename TFunc>
+	double timeRepeated(int repetitions, TFunc func)
+	{
+		func();
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < repetitions; i++)
+			func();
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+	}
+
+	OpenCLExecutor& executor;
+	std::map<std::string, FOCLKernel> kernels;
+	std::vector<std::unique_ptr<OCLDynamicTypedBuffer<cl_uchar>>> scratch;
+	OCLDynamicTypedBuffer<cl_uint> flags;
+	OCLDynamicTypedBuffer<cl_uint> positions;
+	OCLDynamicTypedBuffer<cl_uint> total;
+	FOCLKernel* lastKernel = NULL;
+	size_t workGroupSize = 0;
+	size_t maxGroups = 0;
+	size_t localMemorySize = 0;
+
+	static const size_t ScanItemsPerWorkItem = 4;
+};
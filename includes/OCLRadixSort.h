@@ -0,0 +1,68 @@
+#pragma once
+#include "OpenCLExecutor.h"
+#include <map>
+#include <type_traits>
+
+typedef struct FOCLRadixSortKernels
+{
+	FOCLKernel histogram;
+	FOCLKernel scan;
+	FOCLKernel scatter;
+} FOCLRadixSortKernels;
+
+/** LSD radix sort on the CL device for 32 and 64 bit unsigned keys, optionally moving values along.
+    The sorted data stays on the CL device, download it with GetResultOf or use it in following kernels */
+class OCLRadixSort
+{
+public:
+	OCLRadixSort(OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLRadixSort();
+
+	/** sorts the first count keys ascending
+	    @param count 0 sorts the whole buffer
+	    @param keyBits only the lowest keyBits are compared */
+	template<typename TKey>
+	void sort(OCLDynamicTypedBuffer<TKey>& keys, size_t count = 0, int keyBits = sizeof(TKey) * 8)
+	{
+		static_assert(std::is_unsigned<TKey>::value && (sizeof(TKey) == 4 || sizeof(TKey) == 8), "radix sort keys have to be 32 or 64 bit unsigned");
+
+		if (count == 0)
+			count = keys.getBufferLength();
+
+		runSort(&keys, NULL, count, keyBits, sizeof(TKey), 0);
+	}
+
+	/** sorts the first count keys ascending and reorders the values the same way, equal keys keep their order */
+	template<typename TKey, typename TValue>
+	void sortByKey(OCLDynamicTypedBuffer<TKey>& keys, OCLDynamicTypedBuffer<TValue>& values, size_t count = 0, int keyBits = sizeof(TKey) * 8)
+	{
+		static_assert(std::is_unsigned<TKey>::value && (sizeof(TKey) == 4 || sizeof(TKey) == 8), "radix sort keys have to be 32 or 64 bit unsigned");
+		static_assert(sizeof(TValue) == 1 || sizeof(TValue) == 2 || sizeof(TValue) == 4 || sizeof(TValue) == 8 || sizeof(TValue) == 16, "radix sort values have to be 1, 2, 4, 8 or 16 bytes");
+
+		if (count == 0)
+			count = keys.getBufferLength();
+
+		if (values.getBufferLength() < count)
+			throw OCLException("Radix sort value buffer is smaller than the key buffer!");
+
+		runSort(&keys, &values, count, keyBits, sizeof(TKey), sizeof(TValue));
+	}
+
+	/** reads the sorted keys or values back into host memory */
+	bool downloadResult(OCLVariable* var);
+
+protected:
+	void runSort(OCLVariable* keys, OCLVariable* values, size_t count, int keyBits, size_t keySize, size_t valueSize);
+	FOCLRadixSortKernels& getKernels(size_t keySize, size_t valueSize);
+
+	OpenCLExecutor& executor;
+	std::map<std::pair<size_t, size_t>, FOCLRadixSortKernels> kernelSets;
+	OCLDynamicTypedBuffer<cl_uchar> keyTemp;
+	OCLDynamicTypedBuffer<cl_uchar> valueTemp;
+	OCLDynamicTypedBuffer<cl_uint> groupHist;
+	OCLTypedVariable<cl_ulong, ASPrivate> countArg;
+	OCLTypedVariable<cl_uint, ASPrivate> shiftArg;
+	OCLTypedVariable<cl_ulong, ASPrivate> histCountArg;
+	size_t workGroupSize = 0;
+	FOCLRadixSortKernels* lastKernels = NULL;
+};
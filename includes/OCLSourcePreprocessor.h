@@ -0,0 +1,68 @@
+#pragma once
+#include "MultiplattformTypes.h"
+#include "OpenCLTypes.h"
+#include <map>
+#include <set>
+#include <vector>
+
+/** fully expanded kernel source */
+typedef struct FOCLPreprocessedSource
+{
+	std::string source;
+	/** resolved paths of the main file and every file it includes, a change of one of them invalidates the source */
+	std::vector<std::string> dependencies;
+	/** write time of every dependency when the source was expanded */
+	std::vector<fs::file_time_type> dependencyTimes;
+} FOCLPreprocessedSource;
+
+/** Resolves the #include directives of kernel files.
+    Every file is read and split at its includes once, the expanded sources are cached until one of their dependencies changes on disk.
+    Includes are searched relative to the including file first, then in the search paths. #pragma once is honored. */
+class OCLSourcePreprocessor
+{
+protected:
+	/** text up to an #include directive and the name given in it, the name is empty for the tail of the file */
+	typedef struct FOCLSourceSegment
+	{
+		std::string text;
+		std::string include;
+	} FOCLSourceSegment;
+
+	typedef struct FOCLSourceFile
+	{
+		std::vector<FOCLSourceSegment> segments;
+		bool pragmaOnce = false;
+		fs::file_time_type writeTime;
+	} FOCLSourceFile;
+
+	std::vector<std::string> searchPaths;
+	std::map<std::string, FOCLSourceFile> files;
+	std::map<std::string, FOCLPreprocessedSource> expanded;
+	MUTEXTYPE LOCK;
+
+public:
+	/** search paths default to <cwd>/opencl/ and <cwd>/opencl/include/ */
+	OCLSourcePreprocessor();
+	virtual ~OCLSourcePreprocessor();
+
+	/** the preprocessor used by loadOCLKernel */
+	static OCLSourcePreprocessor& getPreprocessor();
+
+	void addSearchPath(std::string path);
+	void setSearchPaths(std::vector<std::string> paths);
+	std::vector<std::string> getSearchPaths();
+
+	/** expands file, which is resolved against the search paths
+	* @throws OCLException if the file or one of its includes could not be found or the includes are cyclic */
+	FOCLPreprocessedSource expand(std::string file);
+	/** drops all cached files and sources */
+	void clearCache();
+
+protected:
+	/** @Returns the resolved path or an empty string */
+	std::string resolve(const std::string& name, const std::string& includingDir);
+	/** reads and splits the file if it is not cached or changed on disk */
+	const FOCLSourceFile& readFile(const std::string& path);
+	bool isUpToDate(const FOCLPreprocessedSource& source);
+	void expandInto(const std::string& path, FOCLPreprocessedSource& out, std::set<std::string>& onceFiles, std::vector<std::string>& stack);
+};
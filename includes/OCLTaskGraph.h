@@ -0,0 +1,70 @@
+#pragma once
+#include "OpenCLExecutor.h"
+#include "OCLThreadPool.h"
+
+/**
+* Host tasks and kernel launches with dependencies, executed on an OCLThreadPool.
+* Host tasks run on the pool as soon as their dependencies finished. Kernel launches are submitted without blocking
+* and their successors are scheduled by the completion callback of the launch, so no thread waits for the device.
+* A failed task skips all tasks depending on it. The graph is reusable, but must not be changed while it runs
+*/
+class OCLTaskGraph
+{
+public:
+	OCLTaskGraph(OpenCLExecutor& executor = OpenCLExecutor::getExecutor(), OCLThreadPool& pool = OCLThreadPool::getThreadPool());
+	/** waits for a running graph */
+	~OCLTaskGraph();
+
+	OCLTaskGraph(const OCLTaskGraph&) = delete;
+
+	/** @Returns id of the task to be used as dependency */
+	size_t addHostTask(std::function<void()> task, std::vector<size_t> dependencies = std::vector<size_t>());
+	/** launches kernel, downloads are read after it completed. The kernel and variables have to outlive the graph run */
+	size_t addKernel(FOCLKernel& kernel, std::vector<size_t> dependencies = std::vector<size_t>(), std::vector<OCLVariable*> downloads = std::vector<OCLVariable*>());
+
+	/** starts all tasks without dependencies */
+	void run();
+	void wait();
+	/** @Returns false if the graph did not finish in time */
+	bool waitFor(unsigned int milliseconds);
+	bool isFinished();
+	/** failed and skipped tasks of the last run */
+	size_t getFailedCount();
+	size_t size() { return nodes.size(); };
+
+protected:
+	typedef struct FOCLTaskNode
+	{
+		std::function<void()> task;
+		FOCLKernel* kernel = NULL;
+		std::vector<OCLVariable*> downloads;
+		std::vector<size_t> successors;
+		size_t dependencyCount = 0;
+		/** unfinished dependencies in the current run */
+		size_t remaining = 0;
+		bool bDependencyFailed = false;
+		cl::Event event;
+	} FOCLTaskNode;
+
+	typedef struct FOCLCallbackData
+	{
+		OCLTaskGraph* graph;
+		size_t node;
+	} FOCLCallbackData;
+
+	void schedule(size_t node);
+	void execute(size_t node);
+	/** releases the successors of node and schedules the ready ones */
+	void complete(size_t node, bool success);
+	static void CL_CALLBACK onKernelComplete(cl_event event, cl_int status, void* userData);
+
+	OpenCLExecutor& executor;
+	OCLThreadPool& pool;
+	std::vector<FOCLTaskNode> nodes;
+	/** guards the run state of the nodes and the counters */
+	std::mutex lock;
+	std::condition_variable finishedChanged;
+	size_t finishedCount = 0;
+	size_t failedCount = 0;
+	bool bIsRunning = false;
+};
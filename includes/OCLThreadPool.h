@@ -0,0 +1,63 @@
+#pragma once
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+/** Work stealing host worker threads, e.g. for background kernel builds and the host tasks of OCLTaskGraph.
+    Every worker owns a task deque. Tasks enqueued by a worker go to its own deque and are taken newest first,
+    other tasks are distributed round robin. Idle workers steal the oldest tasks of the other deques */
+class OCLThreadPool
+{
+public:
+	/** @param threadCount 0 uses one thread per hardware thread */
+	OCLThreadPool(size_t threadCount = 0);
+	/** finishes all queued tasks before the threads are joined */
+	virtual ~OCLThreadPool();
+
+	OCLThreadPool(const OCLThreadPool&) = delete;
+
+	/** pool shared by the executors */
+	static OCLThreadPool& getThreadPool();
+	/** pool of the background builds of OpenCLExecutor::warmUp. Tasks of getThreadPool may wait for these builds,
+	* on a separate pool the builds never queue behind the tasks waiting for them */
+	static OCLThreadPool& getBuildPool();
+
+	void enqueue(std::function<void()> task);
+	/** blocks until the queue is empty and no task is running, must not be called from a task */
+	void waitIdle();
+	size_t getThreadCount() { return workers.size(); };
+	/** amount of tasks a worker took from the deque of another worker */
+	size_t getStealCount() { return stealCount; };
+	/** @Returns true if the calling thread is a worker of this pool */
+	bool isWorkerThread();
+
+protected:
+	typedef struct FOCLWorkerQueue
+	{
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	} FOCLWorkerQueue;
+
+	void workerLoop(size_t index);
+	/** takes a task reserved by the caller, own deque first */
+	std::function<void()> takeTask(size_t index);
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<FOCLWorkerQueue>> queues;
+	/** guards the counters below */
+	std::mutex lock;
+	std::condition_variable taskAvailable;
+	std::condition_variable idle;
+	/** tasks in the deques not yet reserved by a worker */
+	size_t queuedTasks = 0;
+	/** queued and running tasks */
+	size_t pendingTasks = 0;
+	bool bIsStopping = false;
+	std::atomic<size_t> nextQueue;
+	std::atomic<size_t> stealCount;
+};
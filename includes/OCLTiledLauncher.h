@@ -0,0 +1,63 @@
+#pragma once
+#include "OpenCLExecutor.h"
+
+typedef struct FOCLTiledArgument
+{
+	size_t argIndex = 0;
+	OCLVariable* var = NULL;
+	size_t elementSize = 0;
+	size_t elementCount = 0;
+	/** device buffers of the two tile slots */
+	cl::Buffer slots[2];
+} FOCLTiledArgument;
+
+/**
+* Out of core launches for buffers larger than CL_DEVICE_MAX_MEM_ALLOC_SIZE or the memory budget.
+* The tiled arguments are split into tiles of equal element count, each tile is launched with one work item per element
+* and get_global_offset(0) set to the first element of the tile, so get_global_id(0) is the index in the whole buffer
+* and OCL_TILE_INDEX of Tiling.clh the index in the tile buffer. Two tile slots per argument and separate upload,
+* compute and download queues let the upload of the next tile overlap the compute of the current one.
+* Arguments that are not tiled are passed whole, values written by the kernel to them are read back after the last tile
+*/
+class OCLTiledLauncher
+{
+public:
+	OCLTiledLauncher(FOCLKernel& kernel, OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLTiledLauncher();
+
+	/** splits kernel argument argIndex into tiles along its elements, all tiled arguments need the same element count */
+	OCLTiledLauncher& tile(size_t argIndex);
+	/** elements per tile, 0 derives it from CL_DEVICE_MAX_MEM_ALLOC_SIZE and the memory budget */
+	void setTileElements(size_t elements) { tileElements = elements; };
+	size_t getTileElements();
+	size_t getTileCount();
+
+	/** launches all tiles and blocks until the results are on the host */
+	void run();
+
+protected:
+	/** body of run(), the arguments are acquired by the caller */
+	void runTiles();
+	void uploadTile(size_t tile);
+	void launchTile(size_t tile);
+	void downloadTile(size_t tile);
+	/** first element and element count of tile of the current run */
+	void getTileRange(size_t tile, size_t& start, size_t& count);
+
+	OpenCLExecutor& executor;
+	FOCLKernel& kernel;
+	cl::Device device;
+	cl::Kernel clKernel;
+	std::vector<FOCLTiledArgument> tiled;
+	size_t tileElements = 0;
+	/** elements per tile fixed by run() before it allocates the tile buffers */
+	size_t runTileElements = 1;
+	size_t elementCount = 0;
+	cl::CommandQueue uploadQueue;
+	cl::CommandQueue computeQueue;
+	cl::CommandQueue downloadQueue;
+	/** per slot: last upload, launch and download of the tile using it */
+	cl::Event uploaded[2];
+	cl::Event computed[2];
+	cl::Event downloaded[2];
+};
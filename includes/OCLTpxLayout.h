@@ -0,0 +1,58 @@
+#pragma once
+#include "OpenCLExecutor.h"
+#include "OCLTpxPixel.h"
+
+/** Structure of arrays layout of FTpxPixel hits. Every field is stored in its own aligned buffer,
+    so kernels reading only some fields get coalesced and vectorizable loads */
+class OCLTpxPixelSoABuffer
+{
+public:
+	OCLTpxPixelSoABuffer(size_t length = 0, std::string name = "hits");
+
+	OCLDynamicTypedBuffer<cl_uchar> x;
+	OCLDynamicTypedBuffer<cl_uchar> y;
+	OCLDynamicTypedBuffer<cl_uchar> fToA;
+	OCLDynamicTypedBuffer<cl_ulong> ToA;
+	OCLDynamicTypedBuffer<cl_ushort> ToT;
+
+	void resizeBuffer(size_t length);
+	size_t getBufferLength() { return ToA.getBufferLength(); };
+	/** marks the host copy as outdated, the data was written on the CL device */
+	void setWrittenOnDevice();
+	/** @Returns the buffers in kernel argument order x, y, fToA, ToA, ToT */
+	std::vector<OCLVariable*> getArguments();
+	/** reads the buffers written on the CL device back into the host copies, blocks until they arrived */
+	bool download(cl::CommandQueue& queue);
+	/** reads the host copies, call download first after the buffers were written on the CL device */
+	FTpxPixel getPixel(size_t i);
+};
+
+typedef struct FOCLLayoutBenchmark
+{
+	double aosMilliseconds = 0;
+	double soaMilliseconds = 0;
+	double transposeMilliseconds = 0;
+} FOCLLayoutBenchmark;
+
+/** Runs the AoS to SoA transpose stage on the CL device */
+class OCLTpxLayoutConverter
+{
+public:
+	OCLTpxLayoutConverter(OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLTpxLayoutConverter();
+
+	/** transposes hitCount packed FTpxPixel of aosHits into out, the result stays on the CL device until out.download is called
+	    @param hitCount 0 uses the whole buffer */
+	void convert(OCLVariable* aosHits, OCLTpxPixelSoABuffer& out, size_t hitCount = 0);
+
+	/** times the ToT histogram on the packed and on the transposed hits */
+	FOCLLayoutBenchmark benchmarkToTHistogram(OCLVariable* aosHits, size_t hitCount = 0, int repetitions = 10);
+
+protected:
+	OpenCLExecutor& executor;
+	FOCLKernel transposeKernel;
+	FOCLKernel histogramAoSKernel;
+	FOCLKernel histogramSoAKernel;
+	OCLTypedVariable<cl_ulong, ASPrivate> hitCountArg;
+	size_t workGroupSize = 0;
+};
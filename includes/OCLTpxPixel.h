@@ -0,0 +1,12 @@
+#pragma once
+#include "OpenCLTypes.h"
+
+/** Host mirror of the packed FTpxPixel hit record of TpxPixel.clh */
+PACK(struct FTpxPixel
+{
+	cl_uchar x;
+	cl_uchar y;
+	cl_uchar fToA;
+	cl_ulong ToA;
+	cl_ushort ToT;
+});
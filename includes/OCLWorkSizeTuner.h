@@ -0,0 +1,57 @@
+#pragma once
+#include "OpenCLExecutor.h"
+#include <map>
+#include <mutex>
+
+typedef struct FOCLTuningResult
+{
+	/** NullRange keeps the occupancy based default of the executor */
+	cl::NDRange localRange = cl::NullRange;
+	/** mean device time of one launch */
+	double milliseconds = 0;
+	/** taken from the tuning database without timing */
+	bool bFromDatabase = false;
+} FOCLTuningResult;
+
+/** Empirical local work size selection.
+    Candidate local sizes for a kernel and its global size are timed on a profiling queue and the fastest one is stored
+    in a tuning database per device, driver, source, build options and global size. The database is a text file reused on later runs. */
+class OCLWorkSizeTuner
+{
+public:
+	/** @param databasePath tuning database, an empty path keeps the results in memory only */
+	OCLWorkSizeTuner(std::string databasePath = "ocl_worksizes.db", OpenCLExecutor& executor = OpenCLExecutor::getExecutor());
+	~OCLWorkSizeTuner();
+
+	/** Selects the fastest local size for the current globalThreadCount and sets kernel.localThreadCount.
+	* The kernel is launched with its current arguments for timing, so outputs are overwritten and accumulating kernels accumulate repeatedly
+	* @param forceRetune times the candidates even if the database has a result */
+	FOCLTuningResult tune(FOCLKernel& kernel, int repetitions = 5, bool forceRetune = false);
+	/** local sizes dividing the global size within CL_KERNEL_WORK_GROUP_SIZE, favoring multiples of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE */
+	std::vector<cl::NDRange> getCandidates(FOCLKernel& kernel);
+
+	bool loadDatabase();
+	bool saveDatabase();
+	/** saves the database after every newly tuned kernel, enabled by default */
+	void setAutoSave(bool val) { bAutoSave = val; };
+	size_t getDatabaseSize() { std::lock_guard<std::mutex> guard(lock); return database.size(); };
+
+	static std::string rangeToString(const cl::NDRange& range);
+	static cl::NDRange rangeFromString(const std::string& str);
+
+protected:
+	std::string makeKey(FOCLKernel& kernel);
+	/** @Returns the mean device time of one launch or a negative value if the launch failed */
+	double timeLaunch(FOCLKernel& kernel, const cl::NDRange& localRange, cl::CommandQueue& queue, int repetitions);
+
+	OpenCLExecutor& executor;
+	cl::Device device;
+	FOCLDeviceInfos deviceInfos;
+	std::string databasePath;
+	std::map<std::string, FOCLTuningResult> database;
+	std::mutex lock;
+	bool bAutoSave = true;
+
+	/** limits the timed combinations of 2D and 3D kernels */
+	static const size_t MaxCandidates = 48;
+};
@@ -1,47 +1,130 @@
 #pragma once
 #include "MultiplattformTypes.h"
 #include "OpenCLTypes.h"
+#include "OCLThreadPool.h"
+#include "OCLMemoryManager.h"
 #include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <atomic>
 
-class OpenCLExecutor
+typedef std::pair<unsigned long long, std::string> FOCLProgramKey;
+
+//cl_khr_priority_hints, queues are created with clCreateCommandQueueWithPropertiesKHR of cl_khr_create_command_queue
+#ifndef CL_QUEUE_PRIORITY_KHR
+#define CL_QUEUE_PRIORITY_KHR 0x1096
+#define CL_QUEUE_PRIORITY_HIGH_KHR (1 << 0)
+#define CL_QUEUE_PRIORITY_MED_KHR (1 << 1)
+#define CL_QUEUE_PRIORITY_LOW_KHR (1 << 2)
+#endif
+
+/** launch latencies of one EOCLQueuePriority class */
+typedef struct FOCLLatencyStats
 {
-private:
-	void resolveLockThreadExec();
-protected:
-	OpenCLExecutor();
-	virtual ~OpenCLExecutor();
-	typedef struct FOCLHandledVariable
+	size_t count = 0;
+	/** time waiting for launches of the same or higher classes before the submission */
+	double totalWaitMs = 0;
+	/** from the call of RunInitializedKernel until the kernel finished */
+	double totalLatencyMs = 0;
+	double maxLatencyMs = 0;
+	double lastLatencyMs = 0;
+
+	double getMeanWait() const { return count > 0 ? totalWaitMs / count : 0; };
+	double getMeanLatency() const { return count > 0 ? totalLatencyMs / count : 0; };
+} FOCLLatencyStats;
+
+/** Readiness of the programs of an OpenCLExecutor::warmUp call, copies share the state */
+class OCLBuildHandle
+{
+public:
+	OCLBuildHandle() : state(std::make_shared<FOCLBuildState>()) {};
+
+	bool isReady()
 	{
-		OCLVariable* var;
-		std::vector<FOCLKernelGroup*> associatedGroups;
+		std::lock_guard<std::mutex> guard(state->lock);
+		return state->finished == state->total;
+	}
 
-		void addGroup(FOCLKernelGroup& g)
-		{
-			associatedGroups.push_back(&g);
-		}
+	void wait()
+	{
+		std::unique_lock<std::mutex> guard(state->lock);
+		state->changed.wait(guard, [this]() { return state->finished == state->total; });
+	}
+
+	/** @Returns false if the builds did not finish in time */
+	bool waitFor(unsigned int milliseconds)
+	{
+		std::unique_lock<std::mutex> guard(state->lock);
+		return state->changed.wait_for(guard, std::chrono::milliseconds(milliseconds), [this]() { return state->finished == state->total; });
+	}
+
+	/** amount of programs built by this warm up, programs already cached or in flight are not counted */
+	size_t getProgramCount() { std::lock_guard<std::mutex> guard(state->lock); return state->total; };
+	size_t getFailedCount() { std::lock_guard<std::mutex> guard(state->lock); return state->failed; };
+
+	void addPending(size_t count)
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		state->total += count;
+	}
 
-		void removeGroup(FOCLKernelGroup& g)
+	void finish(bool success)
+	{
 		{
-			for (int i = 0; i < associatedGroups.size(); i++)
-			{
-				if (&g == associatedGroups[i])
-				{
-					associatedGroups.erase(associatedGroups.begin() + i);
-					return;
-				}
-			}
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->finished++;
+			if (!success)
+				state->failed++;
 		}
-	}FOCLHandledVariable;
-	void resolveLocks();
+		state->changed.notify_all();
+	}
+
+protected:
+	typedef struct FOCLBuildState
+	{
+		std::mutex lock;
+		std::condition_variable changed;
+		size_t total = 0;
+		size_t finished = 0;
+		size_t failed = 0;
+	} FOCLBuildState;
+
+	std::shared_ptr<FOCLBuildState> state;
+};
 
+/**
+* Runs kernels on one device with its own context, queues, program cache, memory manager and stats.
+* getExecutor returns the shared default instance, further instances are independent of it and of each other
+* and only share the platform and the OCLThreadPool
+*/
+class OpenCLExecutor
+{
 public:
+	/** independent executor, call InitPlatform or InitDevice before use */
+	OpenCLExecutor();
+	/** waits for the queues and background builds of this executor */
+	virtual ~OpenCLExecutor();
+
+	OpenCLExecutor(const OpenCLExecutor&) = delete;
+
 	bool InitPlatform(int platformIdx = 0, int deviceIdx = 0);
+	/** initializes the executor on device, e.g. a sub-device of partitionDevice */
+	virtual bool InitDevice(cl::Device device);
 	static std::vector<std::string> GetDevices(int platform);
 	static std::vector<std::string> GetPlatforms();
-	/** Gets the OpenCLExecutor only! Implement other Executors in higher classes */
+	/**
+	* Splits device into sub-devices of computeUnits compute units each, so executors on them don't compete for compute units
+	* @Returns the sub-devices, empty if the device can't be partitioned
+	*/
+	static std::vector<cl::Device> partitionDevice(cl::Device device, unsigned int computeUnits);
+	/** Gets the default OpenCLExecutor only! Implement other Executors in higher classes */
 	static OpenCLExecutor& getExecutor();
+	/** waits for the queues and releases the context, queues and programs. The executor can be initialized again afterwards */
 	virtual void DeinitPlatform(); 
 	virtual bool RunKernel(FOCLKernel& kernel, bool shouldBlockVariables = true, const VECTOR_CLASS<cl::Event>* events = NULL, cl::Event* event = NULL);
+	/** checks the local range against the device and kernel limits and initializes the kernel, throws OCLException if it can't be launched */
+	virtual void ValidateKernel(FOCLKernel& kernel);
 	virtual void appendKernelToQueueOf(FOCLKernel& parent, FOCLKernel& child);
 	virtual bool InitKernel(FOCLKernel& kernel);
 	virtual bool RunInitializedKernel(FOCLKernel& kernel, bool shouldBlockVariables = true, const VECTOR_CLASS<cl::Event>* events = NULL, cl::Event* event = NULL);
@@ -66,14 +149,129 @@ public:
 	*/
 	virtual cl::NDRange getMaxLocalNDRange(cl::NDRange globalRange, cl::NDRange rangeRatio = cl::NullRange);
 	bool IsInitialized() { return bIsInitialized; };
+
+	/** amount of built programs, one per source and build option set */
+	size_t getProgramCacheSize();
+	/** drops all cached programs, kernels that are already initialized keep theirs */
+	void clearProgramCache();
+	/** options added to the build of every kernel initialized afterwards */
+	void setGlobalBuildOptions(std::string options);
+	std::string getGlobalBuildOptions();
+	/** profile of kernels with BPDefault, initially BPStandard */
+	void setDefaultBuildProfile(EOCLBuildProfile profile);
+	EOCLBuildProfile getDefaultBuildProfile();
+	std::string getProfileBuildOptions(EOCLBuildProfile profile);
+	/** full options of a kernel: profile, global and kernel options. They are part of the program cache key */
+	std::string getBuildOptions(const FOCLKernel& kernel);
+
+	/**
+	* Builds the programs of all kernels concurrently on the OCLThreadPool and caches them.
+	* InitKernel of a kernel with the same source and build options then takes the cached program or waits for its build without blocking other launches.
+	* Throws OCLException if the executor is not initialized
+	* @Returns handle to wait for the builds
+	*/
+	OCLBuildHandle warmUp(std::vector<FOCLKernel> kernels);
+
+	/**
+	* Records the uploads and launches of all kernels and the downloads afterwards on one in order queue
+	* and submits them with a single lock and flush. Kernels are initialized if necessary.
+	* Transfers never block, also of variables created blocking: the host data of the variables has to stay valid until the returned event completed
+	* @Param events the first command waits for these events
+	* @Param waitForCompletion blocks until the batch finished, otherwise wait for the returned event
+	* @Returns event completing after the last command of the batch
+	*/
+	virtual cl::Event RunBatch(std::vector<FOCLKernel*> kernels, std::vector<OCLVariable*> downloads = std::vector<OCLVariable*>(), const VECTOR_CLASS<cl::Event>* events = NULL, bool waitForCompletion = true);
+
+	/** budget and eviction of the device memory of the variables of this executor, NULL before InitPlatform.
+	* The budget is the global memory of the device unless OCLMemoryManager::setDefaultBudget was called before */
+	std::shared_ptr<OCLMemoryManager> getMemoryManager() { return memoryManager; };
+	/** @Returns true if queues of the priority classes get cl_khr_priority_hints, otherwise they are only scheduled on the host */
+	bool supportsPriorityHints();
+	FOCLLatencyStats getLatencyStats(EOCLQueuePriority priority);
+	void resetLatencyStats();
+
+	/**
+	* Launches kernel without blocking and calls onComplete on the OCLThreadPool as soon as the kernel and the downloads finished.
+	* Downloads never block, also of variables created blocking, their host data is valid when onComplete is called
+	* @Param downloads variables read back after the launch, empty reads every argument the kernel may write
+	* @Param onComplete gets false if the launch or a download failed and the downloaded variables
+	*/
+	virtual void RunKernelAsync(FOCLKernel& kernel, std::function<void(bool, std::vector<OCLVariable*>)> onComplete, std::vector<OCLVariable*> downloads = std::vector<OCLVariable*>());
+	/** calls callback on the OCLThreadPool when event completed, with false if its command failed */
+	static void setCompletionCallback(cl::Event& event, std::function<void(bool)> callback);
+
+	/** queues of helpers (OCLCommandList, OCLTiledLauncher, ...) are finished with the queues of the executor before evicted device data is read back.
+	* Every registered queue has to be unregistered before its owner goes away */
+	void registerQueue(const cl::CommandQueue& queue);
+	void unregisterQueue(const cl::CommandQueue& queue);
+
+	/** work group size limits and memory use of the kernel on the device, initializes the kernel */
+	FOCLKernelResourceInfo getKernelResources(FOCLKernel& kernel);
+	/** readable summary of getKernelResources and the local size chosen for the current global size */
+	std::string getResourceReport(FOCLKernel& kernel);
 	
 protected:
 	static OpenCLExecutor* internalExec;
+	/** guards internalExec and the platform queries */
+	static std::mutex instanceLock;
 	cl::Context* context = NULL;
+	/** unique per created context over all executors, 0 without context */
+	std::atomic<unsigned long long> contextGeneration;
+	static std::atomic<unsigned long long> nextContextGeneration;
 	cl::Device device;
 	cl::Platform platform;
 	std::vector<FOCLKernelGroup*> workingGroups;
+	/** queues finishAllQueues waits for, syncQueueLock is never held while taking another lock */
+	std::vector<cl::CommandQueue> syncQueues;
+	std::mutex syncQueueLock;
+	/** in order queue shared by all batches of RunBatch */
+	cl::CommandQueue* batchQueue = NULL;
+	/** queue sets of the classes other than QPNormal, kernels are assigned round robin */
+	std::vector<cl::CommandQueue*> priorityQueues[3];
+	size_t nextPriorityQueue[3] = { 0, 0, 0 };
+	/** guards the submission gate and the latency stats */
+	std::mutex priorityLock;
+	std::condition_variable priorityChanged;
+	size_t waitingLaunches[3] = { 0, 0, 0 };
+	bool bLaunchActive = false;
+	FOCLLatencyStats latencyStats[3];
+	static const size_t QueuesPerPriority = 2;
 	bool bIsInitialized = false;
-	static MUTEXTYPE CL_LOCK;
+	MUTEXTYPE CL_LOCK;
 	FOCLDeviceInfos deviceInfos;
+	std::shared_ptr<OCLMemoryManager> memoryManager;
+	/** built programs by (sourceHash, build options), specialized kernels reuse the variants already built */
+	std::map<FOCLProgramKey, cl::Program> programCache;
+	/** programs currently built by warmUp or InitKernel */
+	std::set<FOCLProgramKey> pendingBuilds;
+	/** guards programCache, pendingBuilds and the global build options, background builds never take CL_LOCK */
+	std::mutex cacheLock;
+	std::string globalBuildOptions;
+	EOCLBuildProfile defaultBuildProfile = BPStandard;
+	std::condition_variable cacheChanged;
+
+	/** waits for all registered queues, used before the memory manager reads back evicted device data.
+	* Never takes CL_LOCK, evictions happen with and without it */
+	void finishAllQueues();
+	/** deletes the queues and the context, waits for them first. Requires CL_LOCK */
+	void releaseDevice();
+	/** next queue of the set of priority, creates the set on first use. Requires CL_LOCK */
+	cl::CommandQueue* getPriorityQueue(EOCLQueuePriority priority);
+	/** waits until no launch is submitted and no launch of a higher class waits, the gate is released right after the flush of the launch */
+	void acquireLaunch(EOCLQueuePriority priority);
+	void releaseLaunch();
+
+	static void CL_CALLBACK onEventComplete(cl_event event, cl_int status, void* userData);
+	/** fills kernel.resources from the work group info of kernel.clKernel */
+	void collectResources(FOCLKernel& kernel);
+	/** builds kernel.program from an embedded binary or the source, the build log is printed on failure */
+	bool buildProgram(FOCLKernel& kernel, const std::string& options);
+	/** builds kernel.program from an embedded binary matching the device, driver and source
+	* @Returns false if there is none or the runtime rejected it */
+	bool buildFromEmbeddedBinary(FOCLKernel& kernel, const std::string& options);
+	/** waits for a pending build of key, never call it holding CL_LOCK
+	* @Param claim marks key as pending if the program is not cached, the caller has to finishBuild it
+	* @Returns false if the program is not cached */
+	bool getCachedProgram(const FOCLProgramKey& key, cl::Program& program, bool claim = false);
+	void finishBuild(const FOCLProgramKey& key, const cl::Program& program, bool success);
 };
@@ -38,6 +38,7 @@ public:
 		TCM_RGBA = GL_RGBA
 	};
 
+	/** GL sketch of the hit integration, OCLPixelIntegrator integrates without a GL context */
 	std::string getFragmentShaderForPixelIntegration(GLuint inBuffer, GLuint outBuffer);
 	std::string getVertexShaderForPixelIntegration(GLuint inBuffer, GLuint outBuffer);
 	FOpenCLGLImageBound addCLGLImageToKernel(FOCLKernel& kernel, int width, int height, EOGLTextureColorMode mode = EOGLTextureColorMode::TCM_Gray);
@@ -4,6 +4,7 @@
 #define CL_HPP_MINIMUM_OPENCL_VERSION 120
 #include <vector>
 #include <string>
+#include <string_view>
 #include <CL/cl.hpp>
 
 #ifndef __USE_COMPILETIMERESSOURCES__
@@ -13,11 +14,6 @@
 #include <unistd.h>
 #endif
 #endif
-#ifdef  __USE_COMPILETIMERESSOURCES__
-#include "OCLRes.h"
-#include <algorithm>
-#define CALL_OCL_METHOD(_name_) get_##_name_()
-#endif
 #include <fstream>
 #include <sstream>
 #include <assert.h>
@@ -25,6 +21,11 @@
 #include <regex>
 #include <stdexcept>
 #include <memory>
+#include <map>
+#include <iomanip>
+#include <limits>
+#include <type_traits>
+#include <tuple>
 
 namespace cl
 {
@@ -39,6 +40,32 @@ namespace cl
 	}
 }
 
+/** kernel binary compiled ahead of time by OCL_RC --binaries */
+typedef struct FOCLEmbeddedBinary
+{
+	const char* deviceName;
+	const char* driverVersion;
+	const unsigned char* data;
+	size_t size;
+} FOCLEmbeddedBinary;
+
+/** all binaries OCL_RC compiled for one source, they are only valid for the source with sourceHash built with buildOptions */
+typedef struct FOCLEmbeddedBinarySet
+{
+	const FOCLEmbeddedBinary* binaries;
+	size_t count;
+	unsigned long long sourceHash;
+	const char* buildOptions;
+} FOCLEmbeddedBinarySet;
+
+#ifdef  __USE_COMPILETIMERESSOURCES__
+#include "OCLRes.h"
+#include <algorithm>
+#define CALL_OCL_METHOD(_name_) get_##_name_()
+#define CALL_OCL_HASH(_name_) get_##_name_##_hash()
+#define CALL_OCL_BINARIES(_name_) get_##_name_##_binaries()
+#endif
+
 struct OCLException : public std::runtime_error
 {
 	explicit OCLException(std::string _Message) noexcept
@@ -67,6 +94,42 @@ enum EOCLArgumentScope
 	ASPrivate = 2
 };
 
+/** named sets of compiler options, see OpenCLExecutor::getProfileBuildOptions */
+enum EOCLBuildProfile
+{
+	/** the default profile of the executor */
+	BPDefault,
+	/** no additional options */
+	BPStandard,
+	/** correctly rounded single precision division and sqrt if the device supports it */
+	BPPrecise,
+	/** -cl-fast-relaxed-math -cl-mad-enable */
+	BPFast
+};
+
+/** handling of global ranges that are not divisible by the local range */
+enum EOCLRangePadding
+{
+	/** the local range has to divide the global range */
+	RPNone,
+	/** the global range is rounded up to a multiple of the local range, the true size is passed as additional
+	    last argument (uint4, see RangePadding.clh) and the kernel has to skip the padding work items */
+	RPPadded,
+	/** a main launch covers the divisible part, tail launches with a global offset and a driver chosen local range cover the rest.
+	    The kernel must not depend on get_group_id or get_num_groups */
+	RPSplit
+};
+
+/** scheduling class of a kernel, see OpenCLExecutor::getLatencyStats */
+enum EOCLQueuePriority
+{
+	/** submitted before all waiting launches of lower classes, e.g. live previews */
+	QPHigh,
+	QPNormal,
+	/** bulk work, submitted when no other class waits */
+	QPLow
+};
+
 enum EOCLBufferType
 {
 	BTNative,
@@ -75,6 +138,8 @@ enum EOCLBufferType
 	BTGLImage
 };
 
+class OCLMemoryManager;
+
 //Base Type for usage in kernel only!
 class OCLVariable
 {
@@ -84,15 +149,16 @@ public:
 		this->name = name;
 		this->bIsBlocking = bIsBlocking;
 		this->accessType = accessType;
-		CREATEMUTEX(CL_LOCK);
-		CREATEMUTEX(HOST_LOCK);
 		refCount = 0;
 	};
 
-	virtual ~OCLVariable() { /*if(IS_MUTEX_VALID(CL_LOCK)) DESTROYMUTEX(CL_LOCK);*/ };
+	/** the destructors of the subclasses call releaseTracking before they free anything, this only covers subclasses that don't */
+	virtual ~OCLVariable() { releaseTracking(); };
 
 	inline std::string getName() { return this->name; };
 	inline bool getIsBlocking() { return bIsBlocking; };
+	/** CL_TRUE if the variable was created blocking and the caller of the transfer allows blocking */
+	inline cl_bool getTransferBlocking(bool bAllowBlocking) { return (bIsBlocking && bAllowBlocking) ? CL_TRUE : CL_FALSE; };
 	inline EOCLAccessTypes getAccessType() { return accessType; };
 
 	virtual void* getValue() = 0;
@@ -106,11 +172,21 @@ public:
 	virtual EOCLBufferType getBufferType() = 0;
 	virtual size_t getDataOffset() { return 0; };
 	virtual cl::Memory* getCLMemoryObject(cl::Context* context) = 0;
+	/** new host data replaces whatever launches wrote to the device memory */
 	void setVariableChanged(bool val = true)
 	{
 		bisUploaded = !val;
+		if (val)
+			bDeviceWritten = false;
+	}
+	/** called when a launch binds the device memory, evictCLMemory reads back the data of variables kernels may write */
+	void markDeviceWritten()
+	{
+		if (accessType != ATRead && accessType != ATReadCopy)
+			bDeviceWritten = true;
 	}
-	virtual cl_int uploadBuffer(cl::CommandQueue* queue)
+	/** @Param bAllowBlocking false enqueues the transfer without waiting even if the variable was created blocking, the host data has to stay valid until it completed */
+	virtual cl_int uploadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true)
 	{
 		if (this->bisUploaded || this->getCLMemoryObject(NULL) == NULL || this->getAccessType() == ATWrite)
 			return CL_SUCCESS;
@@ -126,20 +202,21 @@ public:
 		if (offset + actualDataSize > getSize())
 			throw OCLException("trying to read from undefined buffer position!");
 
-		cl_int errCode = queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getIsBlocking() ? CL_TRUE : CL_FALSE, offset, actualDataSize, ptr);
+		cl_int errCode = queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getTransferBlocking(bAllowBlocking), offset, actualDataSize, ptr);
 		if(errCode == CL_SUCCESS)
 			bisUploaded = true;
 
 		return errCode;
 	}
 
-	virtual cl_int downloadBuffer(cl::CommandQueue* queue)
+	/** @Param bAllowBlocking false enqueues the read without waiting even if the variable was created blocking, see uploadBuffer */
+	virtual cl_int downloadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true)
 	{
 		if (this->getCLMemoryObject(NULL) == NULL)
 			return CL_SUCCESS;
 
 		if (this->getAccessType() == EOCLAccessTypes::ATWrite || this->getAccessType() == EOCLAccessTypes::ATReadWrite)
-			return queue->enqueueReadBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getIsBlocking() ? CL_TRUE : CL_FALSE, 0, this->getSize(), this->getValue());
+			return queue->enqueueReadBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getTransferBlocking(bAllowBlocking), 0, this->getSize(), this->getValue());
 
 		return CL_SUCCESS;
 	}
@@ -150,27 +227,58 @@ public:
 		return CL_SUCCESS;
 	}
 
-	inline void acquireCLMemory()
-	{
-		if (this->getCLMemoryObject(NULL) != NULL)
-		{
-			ACQUIRE_MUTEX(CL_LOCK);
-		}
-	}
-
-	inline void releaseCLMemory()
-	{
-		RELEASE_MUTEX(CL_LOCK);
-	}
+	/**
+	* Takes the variable for the launches of owner, waits while launches of another owner use it.
+	* An owner may acquire a variable repeatedly, every acquire needs a release
+	* Throws OCLException if the other owner waits for a variable of owner, directly or through further owners
+	*/
+	void acquireCLMemory(const void* owner);
+	/** releases one acquire of owner as soon as event completed, without event right away. No thread waits for the event */
+	void releaseCLMemory(const void* owner, cl::Event* event = NULL);
+	/** blocks until no launch uses the variable */
+	void waitForHostAccess();
+	bool isHostAccessible();
+
+	/** device memory of variables is accounted by OCLMemoryManager, evictable variables may lose their buffer when the budget is exceeded */
+	virtual bool isEvictable() { return bIsManaged; };
+	/** saves device data the host does not have yet, drops the device buffer and marks the variable for re-upload */
+	bool evictCLMemory(cl::CommandQueue* queue);
+	/** use stamp of the device buffer for the LRU order of OCLMemoryManager */
+	unsigned long long getLastUse() { return lastUse; };
+	/** variables of context used before this call may be evicted, called at the start of every launch */
+	static void beginMemoryEpoch(cl::Context* context);
 
 protected:
+	/** creates a device buffer accounted by OCLMemoryManager, least recently used buffers are evicted if it doesn't fit into the budget */
+	cl::Buffer* createManagedBuffer(cl::Context* context, size_t bytes);
+	/** deletes a buffer of createManagedBuffer */
+	void releaseManagedBuffer(cl::Buffer*& buffer);
+	/** accounts memory the variable does not own, it is never evicted */
+	void trackExternalMemory(cl::Memory* memory, cl::Context* context);
+	void touchCLMemory();
+	void forgetCLMemory();
+	/** waits until no launch uses the variable anymore and removes it from OCLMemoryManager.
+	* Has to be called first by every destructor, an eviction meanwhile still needs the memory and the overrides of the subclass */
+	void releaseTracking() { waitForHostAccess(); if (bIsManaged) forgetCLMemory(); };
+	/** deletes the device buffer without saving its data, called by evictCLMemory */
+	virtual void dropCLMemory() {};
+
 	std::string name;
 	bool bisUploaded = false;
+	/** a launch may have written the device memory since the last upload */
+	bool bDeviceWritten = false;
+	bool bIsManaged = false;
+	/** manager of the context of the device buffer */
+	std::shared_ptr<OCLMemoryManager> memoryManager;
+	unsigned long long lastUse = 0;
 	bool bIsBlocking;
 	EOCLAccessTypes accessType;
 	unsigned int refCount = 0;
-	MUTEXTYPE CL_LOCK;
-	MUTEXTYPE HOST_LOCK;
+	/** group whose launches use the variable, guarded by the ownership lock of OCLVariableOwnership.cpp */
+	const void* owner = NULL;
+	size_t ownerUses = 0;
+
+	static void CL_CALLBACK onLaunchComplete(cl_event event, cl_int status, void* userData);
 };
 template<typename T, EOCLArgumentScope TScope = EOCLArgumentScope::ASGlobal>
 class OCLDynamicTypedBuffer : public OCLVariable
@@ -202,6 +310,7 @@ public:
 
 	virtual ~OCLDynamicTypedBuffer() override
 	{
+		this->releaseTracking();
 		if(this->currentSize > 0)
 			delete[] this->value;
 	}
@@ -266,8 +375,7 @@ public:
 	{
 		if (this->currentSize != size)
 		{
-			delete this->memoryBuffer;
-			this->memoryBuffer = NULL;
+			this->releaseManagedBuffer(this->memoryBuffer);
 		}
 		else
 		{
@@ -290,10 +398,19 @@ public:
 			return NULL;
 
 		if (this->memoryBuffer == NULL)
-			this->memoryBuffer = new cl::Buffer(*context, this->getAccessType(), getSize());
+			this->memoryBuffer = this->createManagedBuffer(context, getSize());
+		else
+			this->touchCLMemory();
 
 		return this->memoryBuffer;
 	};
+
+protected:
+	virtual void dropCLMemory() override
+	{
+		delete this->memoryBuffer;
+		this->memoryBuffer = NULL;
+	}
 };
 
 //Base typed variable type
@@ -341,6 +458,7 @@ public:
 
 	virtual ~OCLTypedVariable() override
 	{
+		this->releaseTracking();
 		if (this->memoryBuffer != NULL)
 		{
 			delete this->memoryBuffer;
@@ -368,10 +486,19 @@ public:
 			return NULL;
 
 		if(this->memoryBuffer == NULL)
-		   this->memoryBuffer = new cl::Buffer(*context, this->getAccessType(), this->getSize());
+		   this->memoryBuffer = this->createManagedBuffer(context, this->getSize());
+		else
+			this->touchCLMemory();
 
 		return this->memoryBuffer;
 	};
+
+protected:
+	virtual void dropCLMemory() override
+	{
+		delete this->memoryBuffer;
+		this->memoryBuffer = NULL;
+	}
 };
 
 template<typename T, size_t size, EOCLArgumentScope TScope = EOCLArgumentScope::ASGlobal>
@@ -403,9 +530,13 @@ public:
 
 	virtual ~OCLTypedRingBuffer() override
 	{
+		this->releaseTracking();
 		DESTROYMUTEX(updateMutex);
 	}
 
+	/** only the new part of the ring is uploaded, a dropped device buffer could not be restored */
+	virtual bool isEvictable() override { return false; };
+
 	virtual T& operator[] (size_t i) override
 	{ 
 		i = i % size;
@@ -514,7 +645,7 @@ public:
 		return &this->value[0];
 	}
 
-	virtual cl_int uploadBuffer(cl::CommandQueue* queue) override
+	virtual cl_int uploadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true) override
 	{
 		if (this->bisUploaded || this->getCLMemoryObject(NULL) == NULL || this->getAccessType() == ATWrite)
 			return CL_SUCCESS;
@@ -527,13 +658,13 @@ public:
 
 		if (lreadPos <= readEndPosForCLDevice)
 		{
-			return queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getIsBlocking() ? CL_TRUE : CL_FALSE, lreadPos * sizeof(T), (readEndPosForCLDevice - lreadPos) * sizeof(T), &this->value[lreadPos]);
+			return queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getTransferBlocking(bAllowBlocking), lreadPos * sizeof(T), (readEndPosForCLDevice - lreadPos) * sizeof(T), &this->value[lreadPos]);
 		}
 
 		size_t amoutToEnd = size - lreadPos;
-		cl_int errcode = queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getIsBlocking() ? CL_TRUE : CL_FALSE, lreadPos * sizeof(T), amoutToEnd * sizeof(T), &this->value[lreadPos]);
+		cl_int errcode = queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getTransferBlocking(bAllowBlocking), lreadPos * sizeof(T), amoutToEnd * sizeof(T), &this->value[lreadPos]);
 		if(readEndPosForCLDevice > 0)
-			errcode |= queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getIsBlocking() ? CL_TRUE : CL_FALSE, 0, readEndPosForCLDevice * sizeof(T), &this->value[0]);
+			errcode |= queue->enqueueWriteBuffer(*(cl::Buffer*)this->getCLMemoryObject(NULL), this->getTransferBlocking(bAllowBlocking), 0, readEndPosForCLDevice * sizeof(T), &this->value[0]);
 
 		if (errcode == CL_SUCCESS)
 			this->bisUploaded = true;
@@ -558,6 +689,12 @@ private:
 	void* hostPtr = NULL;
 	EOCLBufferType BufferType = EOCLBufferType::BTCLMem;
 	EOCLAccessTypes HostAccess = EOCLAccessTypes::ATReadWrite;
+	/** part of the image transferred by uploadBuffer and downloadBuffer, all of it if bHasRegion is false */
+	bool bHasRegion = false;
+	size_t regionOrigin[2] = { 0, 0 };
+	size_t regionSize[2] = { 0, 0 };
+	/** bytes between the rows of the host memory, 0 for tightly packed rows */
+	size_t hostRowPitch = 0;
 
 public:
 	OCLMemoryVariable() : OCLTypedVariable<TMem>()
@@ -594,6 +731,11 @@ public:
 		hostPtr = hostPointer;
 	}
 
+	virtual ~OCLMemoryVariable() override
+	{
+		this->releaseTracking();
+	}
+
 	virtual bool needsCLBuffer() override { return false; };
 	virtual EOCLBufferType getBufferType() override { return BufferType; };
 	virtual void* getHostPointer() override { return hostPtr; };
@@ -602,32 +744,80 @@ public:
 		HostAccess = type;
 	}
 	virtual void  setHostPointer(void* val) { hostPtr = val; };
+
+	/**
+	* Restricts uploadBuffer and downloadBuffer of images to a region, the host pointer points to the first pixel of the region then
+	* @Param rowPitch bytes between the rows of the host memory, 0 for tightly packed rows
+	*/
+	void setRegion(size_t x, size_t y, size_t width, size_t height, size_t rowPitch = 0)
+	{
+		bHasRegion = true;
+		regionOrigin[0] = x;
+		regionOrigin[1] = y;
+		regionSize[0] = width;
+		regionSize[1] = height;
+		hostRowPitch = rowPitch;
+	}
+
+	/** uploadBuffer and downloadBuffer transfer the whole image again
+	* @Param rowPitch bytes between the rows of the host memory, 0 for tightly packed rows */
+	void clearRegion(size_t rowPitch = 0)
+	{
+		bHasRegion = false;
+		hostRowPitch = rowPitch;
+	}
+
+	/** size of one pixel of the image in bytes */
+	size_t getImageElementSize()
+	{
+		return (getBufferType() == BTCLImage) ? ((cl::Image*)this->getValue())->getImageInfo<CL_IMAGE_ELEMENT_SIZE>() : 0;
+	}
+
+	/**
+	* Writes width x height pixels from data to the image at x, y. Only the region is transferred
+	* @Param rowPitch bytes between the rows of data, 0 for tightly packed rows
+	* @Param blocking false returns before the transfer finished, data has to stay valid until then
+	*/
+	cl_int writeRegion(cl::CommandQueue* queue, size_t x, size_t y, size_t width, size_t height, const void* data, size_t rowPitch = 0, bool blocking = true, cl::Event* event = NULL)
+	{
+		cl::size_t<3> origin, size;
+		cl::Image* img = getImageRegion(x, y, width, height, origin, size);
+		return queue->enqueueWriteImage(*img, blocking ? CL_TRUE : CL_FALSE, origin, size, rowPitch, 0, data, NULL, event);
+	}
+
+	/** reads width x height pixels of the image at x, y into data with rowPitch bytes per row, see writeRegion */
+	cl_int readRegion(cl::CommandQueue* queue, size_t x, size_t y, size_t width, size_t height, void* data, size_t rowPitch = 0, bool blocking = true, cl::Event* event = NULL)
+	{
+		cl::size_t<3> origin, size;
+		cl::Image* img = getImageRegion(x, y, width, height, origin, size);
+		return queue->enqueueReadImage(*img, blocking ? CL_TRUE : CL_FALSE, origin, size, rowPitch, 0, data, NULL, event);
+	}
+
 	virtual cl::Memory* getCLMemoryObject(cl::Context* context) override
 	{
+		if (context != NULL && !this->bIsManaged)
+			this->trackExternalMemory((cl::Memory*)this->getValue(), context);
+
 		return (cl::Memory*) this->getValue();
 	};
 
-	virtual cl_int uploadBuffer(cl::CommandQueue* queue) override
+	virtual cl_int uploadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true) override
 	{
 		if (this->getAccessType() == ATWrite || HostAccess == ATWrite)
 			return CL_SUCCESS;
 
 		if (this->getBufferType() == BTCLImage && this->getHostPointer() != NULL)
 		{
-			const cl::size_t<3> origin;
-			cl::Image* img = (cl::Image*)this->getValue();
-			cl::size_t<3> size;
-			size[0] = img->getImageInfo<CL_IMAGE_WIDTH>();
-			size[1] = img->getImageInfo<CL_IMAGE_HEIGHT>();
-			size[2] = 1;
-			return queue->enqueueWriteImage(*img, (this->getIsBlocking()) ? CL_TRUE : CL_FALSE, origin, size, 0, 0, this->getHostPointer(), NULL, NULL);
+			cl::size_t<3> origin, size;
+			cl::Image* img = getTransferRegion(origin, size);
+			return queue->enqueueWriteImage(*img, this->getTransferBlocking(bAllowBlocking), origin, size, hostRowPitch, 0, this->getHostPointer(), NULL, NULL);
 		}
 
 		throw OCLException("Trying to upload not implemented memory object!");
 		return -1;
 	}
 
-	virtual cl_int downloadBuffer(cl::CommandQueue* queue) override
+	virtual cl_int downloadBuffer(cl::CommandQueue* queue, bool bAllowBlocking = true) override
 	{
 		if (hostPtr == NULL)
 		{
@@ -636,13 +826,9 @@ public:
 
 		if (getBufferType() == BTCLImage && hostPtr != NULL)
 		{
-			const cl::size_t<3> origin;
-			cl::Image* img = (cl::Image*)this->getValue();
-			cl::size_t<3> size;
-			size[0] = img->getImageInfo<CL_IMAGE_WIDTH>();
-			size[1] = img->getImageInfo<CL_IMAGE_HEIGHT>();
-			size[2] = 1;
-			return queue->enqueueReadImage(*img, this->getIsBlocking() ? CL_TRUE : CL_FALSE, origin, size, 0, 0, hostPtr, 0, 0);
+			cl::size_t<3> origin, size;
+			cl::Image* img = getTransferRegion(origin, size);
+			return queue->enqueueReadImage(*img, this->getTransferBlocking(bAllowBlocking), origin, size, hostRowPitch, 0, hostPtr, 0, 0);
 		}
 
 		throw OCLException("Trying to download unimplemented memory object!");
@@ -657,6 +843,38 @@ public:
 
 
 protected:
+	/** origin and size of a region of the image, throws OCLException if it isn't an image or the region exceeds it */
+	cl::Image* getImageRegion(size_t x, size_t y, size_t width, size_t height, cl::size_t<3>& origin, cl::size_t<3>& size)
+	{
+		if (getBufferType() != BTCLImage)
+			throw OCLException("Region transfers need an image: " + this->getName());
+
+		cl::Image* img = (cl::Image*)this->getValue();
+		size_t imgWidth = img->getImageInfo<CL_IMAGE_WIDTH>();
+		size_t imgHeight = img->getImageInfo<CL_IMAGE_HEIGHT>();
+		if (width == 0 || height == 0 || x + width > imgWidth || y + height > imgHeight)
+			throw OCLException("Image region " + std::to_string(width) + "x" + std::to_string(height) + " at " + std::to_string(x) + "," + std::to_string(y)
+				+ " exceeds the image " + this->getName() + " of " + std::to_string(imgWidth) + "x" + std::to_string(imgHeight));
+
+		origin[0] = x;
+		origin[1] = y;
+		origin[2] = 0;
+		size[0] = width;
+		size[1] = height;
+		size[2] = 1;
+		return img;
+	}
+
+	/** region of uploadBuffer and downloadBuffer */
+	cl::Image* getTransferRegion(cl::size_t<3>& origin, cl::size_t<3>& size)
+	{
+		if (bHasRegion)
+			return getImageRegion(regionOrigin[0], regionOrigin[1], regionSize[0], regionSize[1], origin, size);
+
+		cl::Image* img = (cl::Image*)this->getValue();
+		return getImageRegion(0, 0, img->getImageInfo<CL_IMAGE_WIDTH>(), img->getImageInfo<CL_IMAGE_HEIGHT>(), origin, size);
+	}
+
 	/** possible data type for init image is cl_uint4 */
 	template<typename dType>
 	cl_int initWithValue(cl::CommandQueue* queue, dType* data, size_t size)
@@ -681,16 +899,237 @@ protected:
 	}
 };
 
+/** FNV-1a hash of a kernel source, OCL_RC precomputes the same hash for compile time ressources */
+constexpr unsigned long long oclHashSource(std::string_view source)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (char c : source)
+	{
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+inline cl::NDRange oclMakeRange(size_t dims, const size_t* values)
+{
+	switch (dims)
+	{
+	case 0: return cl::NullRange;
+	case 1: return cl::NDRange(values[0]);
+	case 2: return cl::NDRange(values[0], values[1]);
+	default: return cl::NDRange(values[0], values[1], values[2]);
+	}
+}
+
+/** per kernel limits queried by InitKernel, see OpenCLExecutor::getResourceReport */
+typedef struct FOCLKernelResourceInfo
+{
+	bool bIsValid = false;
+	/** CL_KERNEL_WORK_GROUP_SIZE, limited by the device */
+	size_t maxWorkGroupSize = 0;
+	/** CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE */
+	size_t preferredMultiple = 1;
+	/** static local memory of one work group in bytes */
+	cl_ulong localMemSize = 0;
+	/** private memory of one work item in bytes */
+	cl_ulong privateMemSize = 0;
+	/** reqd_work_group_size of the kernel, 0 if not set */
+	size_t compileWorkGroupSize[3] = { 0, 0, 0 };
+	cl_ulong deviceLocalMemSize = 0;
+	cl_uint computeUnits = 1;
+	size_t maxWorkItems[3] = { 1, 1, 1 };
+
+	/** work groups that fit into the local memory of one compute unit at once */
+	size_t getGroupsPerComputeUnit() const
+	{
+		if (localMemSize == 0)
+			return (size_t)-1;
+		return (size_t)(deviceLocalMemSize / localMemSize);
+	}
+
+	/** elements of elementSize bytes a dynamic local buffer may hold if groupsPerComputeUnit groups have to fit into local memory */
+	size_t getLocalTileElements(size_t elementSize, size_t groupsPerComputeUnit = 2) const
+	{
+		cl_ulong perGroup = deviceLocalMemSize / (groupsPerComputeUnit > 0 ? groupsPerComputeUnit : 1);
+		if (perGroup <= localMemSize || elementSize == 0)
+			return 0;
+		return (size_t)((perGroup - localMemSize) / elementSize);
+	}
+
+	/** Local range keeping all compute units busy with the largest groups the kernel allows, favoring multiples of preferredMultiple.
+	* Without padding the local range has to divide the global range, NullRange is returned if only 1 would fit.
+	* The result of the last global range is cached, launches with an unchanged global range don't search again */
+	cl::NDRange getOccupancyLocalRange(const cl::NDRange& global, bool allowPadding) const
+	{
+		bool cached = bHasCachedRange && cachedPadding == allowPadding && cachedGlobal.dimensions() == global.dimensions();
+		for (size_t d = 0; cached && d < global.dimensions(); d++)
+			cached = cachedGlobal[d] == global[d];
+
+		if (!cached)
+		{
+			cachedLocal = searchOccupancyLocalRange(global, allowPadding);
+			cachedGlobal = global;
+			cachedPadding = allowPadding;
+			bHasCachedRange = true;
+		}
+		return cachedLocal;
+	}
+
+protected:
+	/** candidate search of getOccupancyLocalRange */
+	cl::NDRange searchOccupancyLocalRange(const cl::NDRange& global, bool allowPadding) const
+	{
+		size_t dims = global.dimensions();
+		if (!bIsValid || dims == 0 || dims > 3)
+			return cl::NullRange;
+		if (compileWorkGroupSize[0] != 0)
+			return oclMakeRange(dims, compileWorkGroupSize);
+
+		std::vector<size_t> sizes[3];
+		for (size_t d = 0; d < dims; d++)
+		{
+			for (size_t v = 1; v <= maxWorkItems[d] && v <= maxWorkGroupSize; v++)
+			{
+				bool isPowerOfTwo = (v & (v - 1)) == 0;
+				bool fits = allowPadding || global[d] % v == 0;
+				if (fits && (isPowerOfTwo || (d == 0 && v % preferredMultiple == 0)))
+					sizes[d].push_back(v);
+			}
+		}
+		for (size_t d = dims; d < 3; d++)
+			sizes[d] = { 1 };
+
+		//ranked by: little padding, enough groups for every compute unit, preferred multiple, group size, wide first dimension
+		size_t best[3] = { 1, 1, 1 };
+		std::tuple<bool, bool, bool, size_t, size_t> bestScore(false, false, false, 0, 0);
+		for (size_t x : sizes[0])
+			for (size_t y : sizes[1])
+				for (size_t z : sizes[2])
+				{
+					size_t local[3] = { x, y, z };
+					size_t total = x * y * z;
+					if (total > maxWorkGroupSize)
+						continue;
+
+					size_t groups = 1;
+					double waste = 1.0;
+					for (size_t d = 0; d < dims; d++)
+					{
+						size_t count = (global[d] + local[d] - 1) / local[d];
+						groups *= count;
+						waste *= (double)(count * local[d]) / (double)global[d];
+					}
+
+					std::tuple<bool, bool, bool, size_t, size_t> score(waste <= 1.125, groups >= computeUnits, total % preferredMultiple == 0, total, x);
+					if (score > bestScore)
+					{
+						bestScore = score;
+						best[0] = x;
+						best[1] = y;
+						best[2] = z;
+					}
+				}
+
+		if (!allowPadding && best[0] * best[1] * best[2] == 1)
+			return cl::NullRange;
+
+		return oclMakeRange(dims, best);
+	}
+
+	mutable bool bHasCachedRange = false;
+	mutable bool cachedPadding = false;
+	mutable cl::NDRange cachedGlobal;
+	mutable cl::NDRange cachedLocal;
+} FOCLKernelResourceInfo;
+
+/** Typed compile time constants of a kernel.
+    They are passed as -D build options, so every constant set shares the source and only differs in the build */
+typedef struct FOCLKernelConstants
+{
+	/** literals by name, sorted so equal sets give equal build options */
+	std::map<std::string, std::string> values;
+
+	template<typename T>
+	FOCLKernelConstants& set(const std::string& name, T value)
+	{
+		values[name] = toLiteral(value);
+		return *this;
+	}
+
+	/** value is used as is, e.g. a type name. It must not contain whitespace */
+	FOCLKernelConstants& setRaw(const std::string& name, const std::string& value)
+	{
+		values[name] = value;
+		return *this;
+	}
+
+	bool empty() const { return values.empty(); }
+
+	std::string toBuildOptions() const
+	{
+		std::string ret;
+		for (const auto& v : values)
+			ret += (ret.empty() ? "-D " : " -D ") + v.first + "=" + v.second;
+		return ret;
+	}
+
+	/** OpenCL C literal of value with the matching suffix, e.g. 3u, 2.5f or 7L */
+	template<typename T>
+	static std::string toLiteral(T value)
+	{
+		std::stringstream s;
+		if constexpr (std::is_same<T, bool>::value)
+			s << (value ? 1 : 0);
+		else if constexpr (std::is_floating_point<T>::value)
+		{
+			s << std::setprecision(std::numeric_limits<T>::max_digits10) << std::showpoint << value;
+			if (sizeof(T) == sizeof(float))
+				s << "f";
+		}
+		else if constexpr (std::is_integral<T>::value)
+		{
+			s << +value;
+			if (std::is_unsigned<T>::value)
+				s << "u";
+			if (sizeof(T) == 8)
+				s << "L";
+		}
+		else
+			s << value;
+
+		return s.str();
+	}
+} FOCLKernelConstants;
+
 typedef struct FOCLKernel
 {
 	size_t kernelID = 0;
 	std::string mainMethodName;
 	std::string source;
+	/** oclHashSource of source, InitKernel and warmUp compute it again from the current source */
+	unsigned long long sourceHash = 0;
+	/** ahead of time compiled binaries, preferred over source if one matches the device */
+	FOCLEmbeddedBinarySet binaries = { NULL, 0, 0, "" };
+	/** specialization constants, a different set selects another compiled program */
+	FOCLKernelConstants constants;
+	/** additional compiler options of this kernel, e.g. -cl-std=CL1.2 */
+	std::string buildOptions;
+	EOCLBuildProfile buildProfile = BPDefault;
+	EOCLRangePadding rangePadding = RPNone;
+	/** kernels other than QPNormal run on the queue set of their class, see OpenCLExecutor::RunInitializedKernel */
+	EOCLQueuePriority priority = QPNormal;
+	/** collected by InitKernel */
+	FOCLKernelResourceInfo resources;
 	cl::Program program;
 	cl::Context* context = NULL;
+	/** context generation of the executor when InitKernel set context, kernels of a released context are initialized again */
+	unsigned long long contextGeneration = 0;
 	cl::Device* device = NULL;
 	std::vector<OCLVariable*> Arguments;
 	cl::NDRange globalThreadCount;
+	/** offset of get_global_id, NullRange starts at 0. Only used without rangePadding */
+	cl::NDRange globalOffset;
 	/*WorkItem count per dimension*/
 	cl::NDRange localThreadCount;
 	cl::Kernel clKernel;
@@ -711,6 +1150,7 @@ typedef struct FOCLKernel
 		cl::NDRange localThreadCount = cl::NullRange)
 	{
 		this->source = source;
+		this->sourceHash = oclHashSource(this->source);
 		this->context = NULL;
 		this->program = NULL;
 		this->Arguments = Arguments;
@@ -726,6 +1166,25 @@ typedef struct FOCLKernel
 	{
 		this->mainMethodName = mainMethodName;
 		this->source = source;
+		this->sourceHash = oclHashSource(this->source);
+		this->context = NULL;
+		this->program = NULL;
+		this->Arguments = Arguments;
+		this->globalThreadCount = globalThreadCount;
+		this->localThreadCount = localThreadCount;
+	}
+
+	/** for sources with a precomputed hash, e.g. compile time ressources */
+	FOCLKernel(std::string mainMethodName, std::string_view source, unsigned long long sourceHash,
+		FOCLEmbeddedBinarySet binaries = { NULL, 0, 0, "" },
+		std::vector<OCLVariable*> Arguments = {},
+		cl::NDRange globalThreadCount = cl::NDRange(1),
+		cl::NDRange localThreadCount = cl::NullRange)
+	{
+		this->mainMethodName = mainMethodName;
+		this->source = std::string(source);
+		this->sourceHash = sourceHash;
+		this->binaries = binaries;
 		this->context = NULL;
 		this->program = NULL;
 		this->Arguments = Arguments;
@@ -733,24 +1192,34 @@ typedef struct FOCLKernel
 		this->localThreadCount = localThreadCount;
 	}
 
+	/** options of this kernel without the profile and the global options, see OpenCLExecutor::getBuildOptions */
+	std::string getBuildOptions() const
+	{
+		std::string ret = constants.toBuildOptions();
+		if (!ret.empty() && !buildOptions.empty())
+			ret += " ";
+		return ret + buildOptions;
+	}
+
 } FOCLKernel;
 
 typedef struct FOCLDeviceInfos
 {
 	size_t maxWorkGroupSize;
-	long maxGlobalMemory;
-	long maxDeviceMemory;
+	cl_ulong maxGlobalMemory;
+	cl_ulong maxDeviceMemory;
 	bool imageSupport;
 	size_t maxImage2DSize[2];
 	int maxComputeUnits;
 	cl_uint maxFrequency;
-	long maxCLObjectSize;
+	cl_ulong maxCLObjectSize;
 	int maxWorkGroupDimensions;
 	//length is maxWorkGroupDimensions
 	std::vector<size_t> maxWorkItemsPerDimension;
 	std::string deviceName;
 	std::string clVersion;
 	std::string vendor;
+	std::string driverVersion;
 
 	FOCLDeviceInfos()
 	{
@@ -767,17 +1236,18 @@ typedef struct FOCLDeviceInfos
 		deviceName = "None";
 		clVersion = "0.0";
 		vendor = "None";
+		driverVersion = "0.0";
 	}
 
 	FOCLDeviceInfos(cl::Device& p)
 	{
-		maxGlobalMemory = (long) p.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+		maxGlobalMemory = p.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
 		imageSupport = (p.getInfo<CL_DEVICE_IMAGE_SUPPORT>() == CL_TRUE);
 		maxImage2DSize[0] = p.getInfo<CL_DEVICE_IMAGE2D_MAX_WIDTH>();
 		maxImage2DSize[1] = p.getInfo<CL_DEVICE_IMAGE2D_MAX_HEIGHT>();
-		maxDeviceMemory = (long)p.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+		maxDeviceMemory = p.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
 		maxComputeUnits = p.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
-		maxCLObjectSize = (long)p.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+		maxCLObjectSize = p.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
 		maxWorkGroupSize = p.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
 		maxWorkGroupDimensions = p.getInfo<CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS>();
 		maxWorkItemsPerDimension = p.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
@@ -791,6 +1261,9 @@ typedef struct FOCLDeviceInfos
 		std::stringstream s3;
 		s3 << p.getInfo<CL_DEVICE_VENDOR>();
 		vendor = s3.str();
+		std::stringstream s4;
+		s4 << p.getInfo<CL_DRIVER_VERSION>();
+		driverVersion = s4.str();
 	}
 }FOCLDeviceInfos;
 
@@ -827,6 +1300,33 @@ inline std::string clDecodeErrorCode(cl_int errcode)
 	return ss.str();
 }
 
+typedef struct FOCLTypeDesc
+{
+	std::string name;
+	std::string maxValue;
+	std::string lowestValue;
+	size_t size;
+	bool isFloatingPoint;
+} FOCLTypeDesc;
+
+/** Maps host types onto their OpenCL C type name and limits */
+template<typename T>
+struct FOCLTypeInfo;
+
+#define OCL_TYPE_INFO(_type_, _name_, _max_, _lowest_, _isFloat_) \
+template<> struct FOCLTypeInfo<_type_> { static FOCLTypeDesc get() { return { _name_, _max_, _lowest_, sizeof(_type_), _isFloat_ }; } };
+
+OCL_TYPE_INFO(cl_char, "char", "CHAR_MAX", "CHAR_MIN", false)
+OCL_TYPE_INFO(cl_uchar, "uchar", "UCHAR_MAX", "0", false)
+OCL_TYPE_INFO(cl_short, "short", "SHRT_MAX", "SHRT_MIN", false)
+OCL_TYPE_INFO(cl_ushort, "ushort", "USHRT_MAX", "0", false)
+OCL_TYPE_INFO(cl_int, "int", "INT_MAX", "INT_MIN", false)
+OCL_TYPE_INFO(cl_uint, "uint", "UINT_MAX", "0", false)
+OCL_TYPE_INFO(cl_long, "long", "LONG_MAX", "LONG_MIN", false)
+OCL_TYPE_INFO(cl_ulong, "ulong", "ULONG_MAX", "0", false)
+OCL_TYPE_INFO(cl_float, "float", "FLT_MAX", "(-FLT_MAX)", true)
+OCL_TYPE_INFO(cl_double, "double", "DBL_MAX", "(-DBL_MAX)", true)
+
 inline bool operator== (cl::NDRange& lhs, cl::NDRange& rhs)
 {
 	bool retVal = lhs.dimensions() == rhs.dimensions();
@@ -894,12 +1394,6 @@ typedef struct FOCLKernelGroup
 
 	~FOCLKernelGroup()
 	{
-		if (bIsRunning)
-		{
-			for (int i = 0; i < kernel->Arguments.size(); i++)
-				kernel->Arguments[i]->releaseCLMemory();
-		}
-
 		if(!bIsChild)
 			delete queue;
 
@@ -913,12 +1407,12 @@ typedef struct FOCLKernelGroup
 			delete queue;
 	}
 
-	void UpdateVariable(size_t i)
+	void UpdateVariable(size_t i, bool bAllowBlocking = true)
 	{
 		cl_int errcode = CL_SUCCESS;
 		kernel->Arguments[i]->getCLMemoryObject(kernel->context);
 
-		errcode = kernel->Arguments[i]->uploadBuffer(queue);
+		errcode = kernel->Arguments[i]->uploadBuffer(queue, bAllowBlocking);
 
 		if (CL_SUCCESS != errcode)
 		{
@@ -928,16 +1422,18 @@ typedef struct FOCLKernelGroup
 		}
 	}
 
-	void UploadArguments(bool sync = false, bool reUpload = false)
+	/** @Param flush submits the writes right away, batches flush once after recording all commands and never block on a write */
+	void UploadArguments(bool sync = false, bool reUpload = false, bool flush = true)
 	{
 		for (int i = 0; i < kernel->Arguments.size(); i++)
 		{
 			if(reUpload)
 				kernel->Arguments[i]->setVariableChanged(true);
 
-			UpdateVariable(i);
+			UpdateVariable(i, flush);
 		}
-		queue->flush();
+		if (flush)
+			queue->flush();
 
 		if (sync)
 		{
@@ -956,18 +1452,11 @@ typedef struct FOCLKernelGroup
 		bArgumentsWritten = true;
 	}
 
-	/** WaitforGroup is releasing all variables acquired by Run */
+	/** variables acquired by Run are released by the completion of the launch, not by waiting */
 	void WaitForGroup(FOCLKernel* pkernel = NULL)
 	{
-		if (pkernel == NULL)
-			pkernel = kernel;
 		cl_int errcode = queue->finish();
 
-		//checks if group was active before
-		if(bIsRunning)
-			for (int i = 0; i < pkernel->Arguments.size(); i++)
-				pkernel->Arguments[i]->releaseCLMemory();
-
 		bIsRunning = false;
 
 		if (CL_SUCCESS != errcode)
@@ -1020,14 +1509,120 @@ typedef struct FOCLKernelGroup
 		return ss.str();
 	}
 
+	/** power of two local range of up to 256 work items, spread over all dimensions */
+	static cl::NDRange getPaddingLocalRange(const cl::NDRange& global, FOCLDeviceInfos& info)
+	{
+		size_t dims = global.dimensions();
+		size_t budget = (info.maxWorkGroupSize < 256) ? info.maxWorkGroupSize : 256;
+		size_t local[3] = { 1, 1, 1 };
+		size_t total = 1;
+
+		for (bool grown = true; grown;)
+		{
+			grown = false;
+			for (size_t d = 0; d < dims; d++)
+			{
+				bool fitsDevice = info.maxWorkItemsPerDimension.size() <= d || local[d] * 2 <= info.maxWorkItemsPerDimension[d];
+				if (total * 2 <= budget && local[d] < global[d] && fitsDevice)
+				{
+					local[d] *= 2;
+					total *= 2;
+					grown = true;
+				}
+			}
+		}
+
+		return oclMakeRange(dims, local);
+	}
+
+	/** launches the global range of a kernel with rangePadding, see EOCLRangePadding */
+	void EnqueuePadded(FOCLKernel* pkernel, const VECTOR_CLASS<cl::Event>* events, cl::Event* event)
+	{
+		size_t dims = pkernel->globalThreadCount.dimensions();
+		size_t global[3] = { 1, 1, 1 };
+		size_t local[3] = { 1, 1, 1 };
+		size_t divisible[3] = { 1, 1, 1 };
+		for (size_t d = 0; d < dims; d++)
+		{
+			global[d] = pkernel->globalThreadCount[d];
+			local[d] = pkernel->localThreadCount[d];
+			divisible[d] = (global[d] / local[d]) * local[d];
+		}
+
+		cl_int err = CL_SUCCESS;
+		if (pkernel->rangePadding == RPPadded)
+		{
+			cl_uint4 trueSize = { { (cl_uint)global[0], (cl_uint)global[1], (cl_uint)global[2], 0 } };
+			err = pkernel->clKernel.setArg((cl_uint)pkernel->Arguments.size(), sizeof(cl_uint4), &trueSize);
+			if (CL_SUCCESS != err)
+				throw OCLException("CL ERROR: kernel has no argument for the padded range size! " + clDecodeErrorCode(err));
+
+			size_t padded[3];
+			for (size_t d = 0; d < 3; d++)
+				padded[d] = ((global[d] + local[d] - 1) / local[d]) * local[d];
+
+			err = queue->enqueueNDRangeKernel(pkernel->clKernel, cl::NullRange, oclMakeRange(dims, padded), pkernel->localThreadCount, events, event);
+			if (CL_SUCCESS != err)
+				throw OCLException("CL ERROR: could not start clKernel!" + clDecodeErrorCode(err) + "\n  -> " + printKernelArgInfos() + "\n");
+			return;
+		}
+
+		//the main region and one tail region per dimension: dimensions before d are limited to the divisible part,
+		//dimension d covers the remainder and the following dimensions are complete
+		std::vector<std::pair<cl::NDRange, cl::NDRange>> regions;
+		bool hasMain = true;
+		for (size_t d = 0; d < dims; d++)
+			hasMain &= divisible[d] > 0;
+		if (hasMain)
+			regions.push_back({ cl::NullRange, oclMakeRange(dims, divisible) });
+
+		std::vector<std::pair<cl::NDRange, cl::NDRange>> tails;
+		for (size_t d = 0; d < dims; d++)
+		{
+			size_t offset[3] = { 0, 0, 0 };
+			size_t size[3];
+			bool empty = global[d] == divisible[d];
+			for (size_t k = 0; k < dims; k++)
+			{
+				size[k] = (k < d) ? divisible[k] : global[k];
+				empty |= size[k] == 0;
+			}
+			offset[d] = divisible[d];
+			size[d] = global[d] - divisible[d];
+			if (!empty)
+				tails.push_back({ oclMakeRange(dims, offset), oclMakeRange(dims, size) });
+		}
+
+		//the queue is in order, the event of the last launch completes after all others
+		size_t launchCount = regions.size() + tails.size();
+		size_t launch = 0;
+		for (auto& region : regions)
+		{
+			err = queue->enqueueNDRangeKernel(pkernel->clKernel, region.first, region.second, pkernel->localThreadCount, (launch == 0) ? events : NULL, (launch + 1 == launchCount) ? event : NULL);
+			if (CL_SUCCESS != err)
+				throw OCLException("CL ERROR: could not start clKernel!" + clDecodeErrorCode(err) + "\n  -> " + printKernelArgInfos() + "\n");
+			launch++;
+		}
+		for (auto& tail : tails)
+		{
+			err = queue->enqueueNDRangeKernel(pkernel->clKernel, tail.first, tail.second, cl::NullRange, (launch == 0) ? events : NULL, (launch + 1 == launchCount) ? event : NULL);
+			if (CL_SUCCESS != err)
+				throw OCLException("CL ERROR: could not start clKernel tail!" + clDecodeErrorCode(err) + "\n  -> " + printKernelArgInfos() + "\n");
+			launch++;
+		}
+	}
+
 	size_t gcd(size_t n1, size_t n2) {
 		return (n2 == 0) ? n1 : gcd(n2, n1 % n2);
 	}
 
-	/** WaitforGroup is needed to free all variables acquired by this call 
+	/** Buffer arguments are owned by this group until the launch completed on the device, launches of other groups using them wait
 	    @param pkernel modified kernel for update of var
 	*/
-	void Run(const VECTOR_CLASS<cl::Event>* events = NULL, cl::Event* event = NULL, FOCLKernel* pkernel = NULL)
+	/** @Param bSubmit false only records the uploads and the launch without waiting for the uploads or flushing the queue
+	    @Param acquired variables AcquireVariables took for this group before, Run acquires them itself if NULL
+	*/
+	void Run(const VECTOR_CLASS<cl::Event>* events = NULL, cl::Event* event = NULL, FOCLKernel* pkernel = NULL, bool bSubmit = true, const std::vector<OCLVariable*>* acquired = NULL)
 	{
 		if (pkernel == NULL)
 			pkernel = kernel;
@@ -1037,17 +1632,76 @@ typedef struct FOCLKernelGroup
 			bArgumentsWritten = false;
 		}
 
-		if (bShouldBlockVariables)
+		//buffers of this launch are used after this point and are not evicted for it
+		OCLVariable::beginMemoryEpoch(pkernel->context);
+
+		if (!bShouldBlockVariables)
+		{
+			bIsRunning = true;
+			Enqueue(events, event, pkernel, bSubmit);
+			return;
+		}
+
+		//the launch event releases the variables, no thread waits for the device
+		std::vector<OCLVariable*> owned = (acquired != NULL) ? *acquired : AcquireVariables(pkernel, this);
+		cl::Event launchEvent;
+		if (event == NULL)
+			event = &launchEvent;
+		try
+		{
+			bIsRunning = true;
+			Enqueue(events, event, pkernel, bSubmit);
+		}
+		catch (...)
+		{
+			for (OCLVariable* var : owned)
+				var->releaseCLMemory(this);
+			throw;
+		}
+
+		for (OCLVariable* var : owned)
+			var->releaseCLMemory(this, event);
+	}
+
+	/** Takes the variables of pkernel with device memory for owner, waits while launches of other owners use them.
+	* Waits on other launches, so never call it holding CL_LOCK
+	*/
+	static std::vector<OCLVariable*> AcquireVariables(FOCLKernel* pkernel, const void* owner)
+	{
+		std::vector<OCLVariable*> ret;
+		try
 		{
 			for (int i = 0; i < pkernel->Arguments.size(); i++)
-				pkernel->Arguments[i]->acquireCLMemory();
+			{
+				//device memory is created later by the launch, only its existence or need is checked here
+				OCLVariable* var = pkernel->Arguments[i];
+				if (var->getCLMemoryObject(NULL) == NULL && !var->needsCLBuffer())
+					continue;
+				var->acquireCLMemory(owner);
+				ret.push_back(var);
+			}
+		}
+		catch (...)
+		{
+			ReleaseVariables(ret, owner);
+			throw;
 		}
+		return ret;
+	}
 
-		bIsRunning = true;
+	/** gives back the variables of AcquireVariables as soon as event completed, without event right away */
+	static void ReleaseVariables(const std::vector<OCLVariable*>& vars, const void* owner, cl::Event* event = NULL)
+	{
+		for (OCLVariable* var : vars)
+			var->releaseCLMemory(owner, event);
+	}
 
+	/** uploads the arguments and enqueues the launch of pkernel */
+	void Enqueue(const VECTOR_CLASS<cl::Event>* events, cl::Event* event, FOCLKernel* pkernel, bool bSubmit)
+	{
 		if (!bArgumentsWritten)
 		{
-			UploadArguments(true, false);
+			UploadArguments(bSubmit, false, bSubmit);
 		}
 
 		cl_int err = CL_SUCCESS;
@@ -1062,25 +1716,51 @@ typedef struct FOCLKernelGroup
 			else
 			{
 				err = pkernel->clKernel.setArg(i, *pkernel->Arguments[i]->getCLMemoryObject(pkernel->context));
+				pkernel->Arguments[i]->markDeviceWritten();
 			}
 			if (CL_SUCCESS != err)
 				std::printf("CL ERROR: could not assign Argument(%i) to clKernel! [%s]\n", i, clDecodeErrorCode(err).c_str());
 		}
 
-		if (pkernel->localThreadCount.dimensions() == 0)
+		if (pkernel->rangePadding != RPNone && pkernel->globalThreadCount.dimensions() > 0)
+		{
+			if (pkernel->localThreadCount.dimensions() == 0 && pkernel->resources.bIsValid)
+				pkernel->localThreadCount = pkernel->resources.getOccupancyLocalRange(pkernel->globalThreadCount, true);
+			else if (pkernel->localThreadCount.dimensions() == 0)
+			{
+				FOCLDeviceInfos info = FOCLDeviceInfos(*pkernel->device);
+				pkernel->localThreadCount = getPaddingLocalRange(pkernel->globalThreadCount, info);
+			}
+
+			EnqueuePadded(pkernel, events, event);
+		}
+		else
 		{
-			FOCLDeviceInfos info = FOCLDeviceInfos(*pkernel->device);
-			pkernel->localThreadCount = pkernel->globalThreadCount;
-			for (size_t i = 0; i < pkernel->localThreadCount.dimensions(); i++)
+			cl::NDRange localRange = pkernel->localThreadCount;
+			if (localRange.dimensions() == 0 && pkernel->resources.bIsValid)
+			{
+				//NullRange leaves the choice to the driver if no good divisor exists
+				localRange = pkernel->resources.getOccupancyLocalRange(pkernel->globalThreadCount, false);
+			}
+			else if (localRange.dimensions() == 0)
 			{
-				if (info.maxWorkItemsPerDimension[i] < pkernel->localThreadCount[i])
-					pkernel->localThreadCount = gcd(info.maxWorkItemsPerDimension[i], pkernel->globalThreadCount[i]);
+				FOCLDeviceInfos info = FOCLDeviceInfos(*pkernel->device);
+				pkernel->localThreadCount = pkernel->globalThreadCount;
+				for (size_t i = 0; i < pkernel->localThreadCount.dimensions(); i++)
+				{
+					if (info.maxWorkItemsPerDimension[i] < pkernel->localThreadCount[i])
+						pkernel->localThreadCount = gcd(info.maxWorkItemsPerDimension[i], pkernel->globalThreadCount[i]);
+				}
+				localRange = pkernel->localThreadCount;
 			}
+
+			err = queue->enqueueNDRangeKernel(pkernel->clKernel, pkernel->globalOffset, pkernel->globalThreadCount, localRange, events, event);
+			if (CL_SUCCESS != err)
+				throw OCLException("CL ERROR: could not start clKernel!" + clDecodeErrorCode(err) + "\n  -> " + printKernelArgInfos() +"\n");
 		}
+		if (!bSubmit)
+			return;
 
-		err = queue->enqueueNDRangeKernel(pkernel->clKernel, cl::NDRange(0), pkernel->globalThreadCount, pkernel->localThreadCount, events, event);
-		if (CL_SUCCESS != err)
-			throw OCLException("CL ERROR: could not start clKernel!" + clDecodeErrorCode(err) + "\n  -> " + printKernelArgInfos() +"\n");
 		err = queue->flush();
 		if(CL_SUCCESS != err)
 			throw OCLException("CL ERROR: could not start clKernel!" + clDecodeErrorCode(err) + "\n  -> " + printKernelArgInfos() + "\n");
@@ -1094,66 +1774,23 @@ inline FOCLKernel __dynamicConstantsFill(FOCLKernel kernel, std::vector<std::pai
 	{
 		ReplaceStringInPlace(kernel.source, "%" + DynamicConstants[i].first + "%", DynamicConstants[i].second);
 	}
+	kernel.sourceHash = oclHashSource(kernel.source);
 
 	return kernel;
 }
 
-inline FOCLKernel loadOCLKernel_helper(std::string name, std::string mainMethodName = "main_kernel")
-{
-	std::string cwd = fs::current_path().string();
-	std::string basepath = cwd + "/opencl/";
-	std::ifstream t(basepath + name + ".cl");
-	std::stringstream buffer;
-	buffer << t.rdbuf();
-	std::string source = buffer.str();
-
-	std::smatch m;
-	std::regex e("#include\\s*\"[\\w\\/\\\\.]{2,}\"");
-	std::regex e2("\"[\\w\\/\\\\.]+\"");
-	while (std::regex_search(source, m, e)) {
-		for (auto x : m)
-		{
-			std::string include_line = x.str();
-			std::smatch m2;
-			std::regex_search(include_line, m2, e2);
-			for (std::ssub_match x2 : m2)
-			{
-				std::string path = x2.str();
-				path = path.substr(1, path.length() - 2);				
-				if(fileExists(basepath + path))
-					path = basepath + path;
-				else
-				{
-					path = basepath + "include/" + path;
-					if (!fileExists(path))
-					{
-						std::printf(" ERROR: Could not find cl include file: %s!\n", path.c_str());
-						exit(-1);
-					}
-				}
-
-				std::ifstream t2(path);
-				std::stringstream buffer2;
-				buffer2 << t2.rdbuf();
-				ReplaceStringInPlace(source, include_line, buffer2.str() + "\n");
-				break;
-			}
-
-		}
-	};
-
-	FOCLKernel kernel(mainMethodName, source);
-
-	return kernel;
-}
+/** loads opencl/<name>.cl with all includes expanded by OCLSourcePreprocessor::getPreprocessor()
+* @throws OCLException if the file or one of its includes is missing */
+FOCLKernel loadOCLKernel_helper(std::string name, std::string mainMethodName = "main_kernel");
 
 #define loadOCLKernel(_name_, mainMethodName) loadOCLKernel_helper(#_name_, mainMethodName)
 #define loadOCLKernelAndConstants(_name_, mainMethodName, DynamicConstants) __dynamicConstantsFill(loadOCLKernel_helper(#_name_, mainMethodName), DynamicConstants)
 #endif
 
 #ifdef __USE_COMPILETIMERESSOURCES__
-inline std::string __dynamicConstantsFill(std::string& source, std::vector<std::pair<std::string, std::string>> DynamicConstants = std::vector<std::pair<std::string, std::string>>())
+inline std::string __dynamicConstantsFill(std::string_view staticSource, std::vector<std::pair<std::string, std::string>> DynamicConstants = std::vector<std::pair<std::string, std::string>>())
 {
+	std::string source(staticSource);
 	for (size_t i = 0; i < DynamicConstants.size(); i++)
 	{
 		ReplaceStringInPlace(source, "%" + DynamicConstants[i].first + "%", DynamicConstants[i].second);
@@ -1162,7 +1799,16 @@ inline std::string __dynamicConstantsFill(std::string& source, std::vector<std::
 	return source;
 }
 
-#define loadOCLKernel(_name_, mainMethodName) FOCLKernel(mainMethodName, CALL_OCL_METHOD(_name_))
+#define loadOCLKernel(_name_, mainMethodName) FOCLKernel(mainMethodName, CALL_OCL_METHOD(_name_), CALL_OCL_HASH(_name_), CALL_OCL_BINARIES(_name_))
 #define loadOCLKernelAndConstants(_name_, mainMethodName, DynamicConstants) FOCLKernel(mainMethodName, __dynamicConstantsFill(CALL_OCL_METHOD(_name_), DynamicConstants))
 
-#endif
\ No newline at end of file
+#endif
+
+/** kernel with typed specialization constants, see FOCLKernelConstants */
+inline FOCLKernel __specializeKernel(FOCLKernel kernel, const FOCLKernelConstants& constants)
+{
+	kernel.constants = constants;
+	return kernel;
+}
+
+#define loadOCLKernelSpecialized(_name_, mainMethodName, Constants) __specializeKernel(loadOCLKernel(_name_, mainMethodName), Constants)
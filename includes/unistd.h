@@ -55,4 +55,7 @@ typedef unsigned __int32  uint32_t;
 typedef unsigned __int64  uint64_t;
 
 #endif /* unistd.h  */
+#else
+/* the includes dir shadows the system header on POSIX builds */
+#include_next <unistd.h>
 #endif //WIN32
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "OCLCommandList.h"
+#include <string.h>
+
+OCLCommandList::OCLCommandList(OpenCLExecutor& executor)
+	: executor(executor)
+{
+	context = executor.getContext();
+	queue = cl::CommandQueue(context, executor.getDefaultDevice());
+	executor.registerQueue(queue);
+}
+
+OCLCommandList::~OCLCommandList()
+{
+	queue.finish();
+	executor.unregisterQueue(queue);
+	clear();
+}
+
+OCLCommandList & OCLCommandList::upload(OCLVariable * var)
+{
+	FOCLRecordedCommand command;
+	command.type = CTUpload;
+	command.var = var;
+	commands.push_back(command);
+	return *this;
+}
+
+OCLCommandList & OCLCommandList::launch(FOCLKernel & kernel)
+{
+	executor.ValidateKernel(kernel);
+
+	FOCLRecordedCommand command;
+	command.type = CTLaunch;
+	command.group = std::make_shared<FOCLKernelGroup>(kernel, &queue);
+
+	//own kernel object, the arguments set here stay untouched by other launches
+	FOCLKernel* recorded = command.group->kernel;
+	recorded->clKernel = cl::Kernel(recorded->program, recorded->mainMethodName.c_str());
+
+	if (recorded->localThreadCount.dimensions() == 0 && recorded->resources.bIsValid)
+		recorded->localThreadCount = recorded->resources.getOccupancyLocalRange(recorded->globalThreadCount, recorded->rangePadding != RPNone);
+	if (recorded->localThreadCount.dimensions() == 0 && recorded->rangePadding != RPNone)
+	{
+		FOCLDeviceInfos info(*recorded->device);
+		recorded->localThreadCount = FOCLKernelGroup::getPaddingLocalRange(recorded->globalThreadCount, info);
+	}
+
+	bindArguments(command, true);
+	commands.push_back(command);
+	return *this;
+}
+
+OCLCommandList & OCLCommandList::download(OCLVariable * var)
+{
+	FOCLRecordedCommand command;
+	command.type = CTDownload;
+	command.var = var;
+	commands.push_back(command);
+	return *this;
+}
+
+cl::Event OCLCommandList::replay(bool waitForCompletion)
+{
+	rebindCount = 0;
+	cl_int err = CL_SUCCESS;
+
+	//the list owns its variables until the marker completed, launches of other groups are ordered after it
+	std::vector<OCLVariable*> acquired;
+	try
+	{
+		for (FOCLRecordedCommand& command : commands)
+		{
+			if (command.type == CTLaunch)
+			{
+				std::vector<OCLVariable*> vars = FOCLKernelGroup::AcquireVariables(command.group->kernel, this);
+				acquired.insert(acquired.end(), vars.begin(), vars.end());
+			}
+			else
+			{
+				command.var->acquireCLMemory(this);
+				acquired.push_back(command.var);
+			}
+		}
+	}
+	catch (...)
+	{
+		FOCLKernelGroup::ReleaseVariables(acquired, this);
+		throw;
+	}
+
+	cl::Event ret;
+	try
+	{
+		for (FOCLRecordedCommand& command : commands)
+		{
+			switch (command.type)
+			{
+			case CTUpload:
+				command.var->getCLMemoryObject(&context);
+				command.var->setVariableChanged(true);
+				err = command.var->uploadBuffer(&queue);
+				if (CL_SUCCESS != err)
+					std::printf("CL ERROR: could not write buffer with name: %s to CL device! [%s]\n", command.var->getName().c_str(), clDecodeErrorCode(err).c_str());
+				break;
+			case CTLaunch:
+			{
+				FOCLKernelGroup& group = *command.group;
+				FOCLKernel* recorded = group.kernel;
+				for (size_t i = 0; i < recorded->Arguments.size(); i++)
+					group.UpdateVariable(i);
+
+				bindArguments(command, false);
+
+				if (recorded->rangePadding != RPNone)
+					group.EnqueuePadded(recorded, NULL, NULL);
+				else
+				{
+					err = queue.enqueueNDRangeKernel(recorded->clKernel, recorded->globalOffset, recorded->globalThreadCount, recorded->localThreadCount);
+					if (CL_SUCCESS != err)
+						throw OCLException("CL ERROR: could not start clKernel!" + clDecodeErrorCode(err) + "\n  -> " + group.printKernelArgInfos() + "\n");
+				}
+				break;
+			}
+			case CTDownload:
+				err = command.var->downloadBuffer(&queue);
+				if (CL_SUCCESS != err)
+					std::printf("CL ERROR: could not read buffer with name: %s from CL device! [%s]\n", command.var->getName().c_str(), clDecodeErrorCode(err).c_str());
+				break;
+			}
+		}
+
+		err = queue.enqueueMarkerWithWaitList(NULL, &ret);
+		if (CL_SUCCESS == err)
+			err = queue.flush();
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: could not submit command list! " + clDecodeErrorCode(err));
+	}
+	catch (...)
+	{
+		//commands enqueued before the failure may still use the variables
+		queue.finish();
+		FOCLKernelGroup::ReleaseVariables(acquired, this);
+		throw;
+	}
+	FOCLKernelGroup::ReleaseVariables(acquired, this, &ret);
+
+	if (waitForCompletion)
+	{
+		err = ret.wait();
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: command list did not complete! " + clDecodeErrorCode(err));
+	}
+
+	return ret;
+}
+
+void OCLCommandList::clear()
+{
+	commands.clear();
+}
+
+void OCLCommandList::bindArguments(FOCLRecordedCommand & command, bool force)
+{
+	FOCLKernel* recorded = command.group->kernel;
+	size_t count = recorded->Arguments.size();
+	command.boundMemory.resize(count, NULL);
+	command.boundValues.resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		OCLVariable* var = recorded->Arguments[i];
+		cl::Memory* mem = var->getCLMemoryObject(recorded->context);
+		cl_int err = CL_SUCCESS;
+
+		if (mem != NULL)
+		{
+			var->markDeviceWritten();
+			if (!force && (*mem)() == command.boundMemory[i])
+				continue;
+
+			err = recorded->clKernel.setArg((cl_uint)i, *mem);
+			command.boundMemory[i] = (*mem)();
+		}
+		else
+		{
+			const char* value = (const char*)var->getValue();
+			std::vector<char>& bound = command.boundValues[i];
+			if (!force && bound.size() == var->getSize() && memcmp(bound.data(), value, bound.size()) == 0)
+				continue;
+
+			err = recorded->clKernel.setArg((cl_uint)i, var->getSize(), var->getValue());
+			bound.assign(value, value + var->getSize());
+			command.boundMemory[i] = NULL;
+		}
+
+		if (CL_SUCCESS != err)
+			std::printf("CL ERROR: could not assign Argument(%zi) to clKernel! [%s]\n", i, clDecodeErrorCode(err).c_str());
+		if (!force)
+			rebindCount++;
+	}
+}
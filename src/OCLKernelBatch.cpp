@@ -0,0 +1,49 @@
+#include "OCLKernelBatch.h"
+
+OCLKernelBatch::OCLKernelBatch(OpenCLExecutor& executor)
+	: executor(executor)
+{
+}
+
+OCLKernelBatch::~OCLKernelBatch()
+{
+	wait();
+}
+
+OCLKernelBatch & OCLKernelBatch::add(FOCLKernel & kernel)
+{
+	kernels.push_back(&kernel);
+	return *this;
+}
+
+OCLKernelBatch & OCLKernelBatch::download(OCLVariable * var)
+{
+	downloads.push_back(var);
+	return *this;
+}
+
+cl::Event OCLKernelBatch::submit(const VECTOR_CLASS<cl::Event>* events, bool waitForCompletion)
+{
+	wait();
+	lastSubmit = executor.RunBatch(kernels, downloads, events, waitForCompletion);
+	bHasSubmitted = !waitForCompletion;
+	return lastSubmit;
+}
+
+void OCLKernelBatch::wait()
+{
+	if (!bHasSubmitted)
+		return;
+
+	bHasSubmitted = false;
+	cl_int err = lastSubmit.wait();
+	if (CL_SUCCESS != err)
+		std::printf("CL ERROR: batch did not complete! [%s]\n", clDecodeErrorCode(err).c_str());
+}
+
+void OCLKernelBatch::clear()
+{
+	wait();
+	kernels.clear();
+	downloads.clear();
+}
@@ -0,0 +1,251 @@
+#include "OCLMatVariable.h"
+#include <string.h>
+
+namespace
+{
+	cv::AccessFlag getMatAccess(EOCLAccessTypes accessType)
+	{
+		if (accessType == ATRead || accessType == ATReadCopy)
+			return cv::ACCESS_READ;
+		if (accessType == ATWrite)
+			return cv::ACCESS_WRITE;
+		return cv::ACCESS_RW;
+	}
+
+	void copyRows(unsigned char* dst, size_t dstPitch, const unsigned char* src, size_t srcPitch, size_t rowBytes, size_t rows)
+	{
+		for (size_t r = 0; r < rows; r++)
+			memcpy(dst + r * dstPitch, src + r * srcPitch, rowBytes);
+	}
+}
+
+OCLMatVariable::OCLMatVariable(cv::Mat mat, std::string name, EOCLMatBinding binding, bool bIsBlocking, EOCLAccessTypes accessType)
+	: OCLVariable(name, bIsBlocking, accessType), mat(mat), binding(binding)
+{
+	if (mat.empty())
+		throw OCLException("Can't bind an empty cv::Mat: " + name);
+	if (binding == MBImage)
+		getImageFormat(mat.type());
+}
+
+OCLMatVariable::OCLMatVariable(cv::UMat umat, std::string name, bool bIsBlocking, EOCLAccessTypes accessType)
+	: OCLVariable(name, bIsBlocking, accessType), umat(umat), binding(MBBuffer)
+{
+	bHasUMat = true;
+}
+
+OCLMatVariable::~OCLMatVariable()
+{
+	//the Mat has to outlive the device use of its memory
+	releaseTracking();
+	delete memory;
+}
+
+cl::ImageFormat OCLMatVariable::getImageFormat(int type)
+{
+	cl_channel_order order;
+	switch (CV_MAT_CN(type))
+	{
+	case 1: order = CL_R; break;
+	case 2: order = CL_RG; break;
+	case 4: order = CL_RGBA; break;
+	default: throw OCLException("No image channel order for cv::Mat with " + std::to_string(CV_MAT_CN(type)) + " channels");
+	}
+
+	cl_channel_type channelType;
+	switch (CV_MAT_DEPTH(type))
+	{
+	case CV_8U: channelType = CL_UNSIGNED_INT8; break;
+	case CV_8S: channelType = CL_SIGNED_INT8; break;
+	case CV_16U: channelType = CL_UNSIGNED_INT16; break;
+	case CV_16S: channelType = CL_SIGNED_INT16; break;
+	case CV_32S: channelType = CL_SIGNED_INT32; break;
+	case CV_32F: channelType = CL_FLOAT; break;
+	default: throw OCLException("No image channel type for cv::Mat depth " + std::to_string(CV_MAT_DEPTH(type)));
+	}
+
+	return cl::ImageFormat(order, channelType);
+}
+
+void OCLMatVariable::setValue(void * val)
+{
+	throw OCLException("OCLMatVariable can't change its cv::Mat, create a new variable: " + name);
+}
+
+size_t OCLMatVariable::getSize()
+{
+	if (mat.empty())
+		return 0;
+	return (mat.rows - 1) * mat.step[0] + mat.cols * mat.elemSize();
+}
+
+cl::Memory * OCLMatVariable::getCLMemoryObject(cl::Context * context)
+{
+	if (context == NULL)
+		return memory;
+
+	if (memory != NULL)
+	{
+		if (memoryContext != (*context)())
+			throw OCLException("cv::Mat variable " + name + " is bound to another context");
+		return memory;
+	}
+
+	createMemory(context);
+	return memory;
+}
+
+bool OCLMatVariable::bindUMatBuffer(cl::Context * context)
+{
+	cl_mem handle = (cl_mem)umat.handle(getMatAccess(accessType));
+	if (handle == NULL || umat.offset != 0)
+		return false;
+
+	//cl::Buffer takes over one reference, the UMat keeps its own
+	if (CL_SUCCESS != clRetainMemObject(handle))
+		return false;
+	cl::Buffer* buffer = new cl::Buffer(handle);
+	cl::Context bufferContext = buffer->getInfo<CL_MEM_CONTEXT>();
+	if (bufferContext() != (*context)())
+	{
+		delete buffer;
+		return false;
+	}
+
+	memory = buffer;
+	return true;
+}
+
+void OCLMatVariable::createMemory(cl::Context * context)
+{
+	memoryContext = (*context)();
+	if (bHasUMat)
+	{
+		if (bindUMatBuffer(context))
+		{
+			//OpenCV keeps the host and device data of the UMat in sync itself
+			bIsZeroCopy = true;
+			bisUploaded = true;
+			trackExternalMemory(memory, context);
+			return;
+		}
+
+		std::printf("UMat %s is not in the context of the launch, binding its host data\n", name.c_str());
+		mat = umat.getMat(getMatAccess(accessType));
+	}
+
+	std::vector<cl::Device> devices = context->getInfo<CL_CONTEXT_DEVICES>();
+	bool unified = devices.size() > 0 && devices[0].getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() == CL_TRUE;
+	cl_mem_flags access = accessType & (CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY);
+
+	cl_int err = CL_SUCCESS;
+	for (int attempt = unified ? 0 : 1; attempt < 2; attempt++)
+	{
+		//the device works on the Mat directly, otherwise on pinned memory the Mat is copied to
+		bIsZeroCopy = (attempt == 0);
+		cl_mem_flags flags = access | (bIsZeroCopy ? CL_MEM_USE_HOST_PTR : CL_MEM_ALLOC_HOST_PTR);
+		void* hostPtr = bIsZeroCopy ? mat.data : NULL;
+
+		if (binding == MBImage)
+			memory = new cl::Image2D(*context, flags, getImageFormat(mat.type()), mat.cols, mat.rows, bIsZeroCopy ? mat.step[0] : 0, hostPtr, &err);
+		else
+			memory = new cl::Buffer(*context, flags, getSize(), hostPtr, &err);
+
+		if (CL_SUCCESS == err)
+			break;
+
+		//e.g. a row pitch or address the device can't use in place
+		delete memory;
+		memory = NULL;
+	}
+
+	if (CL_SUCCESS != err)
+		throw OCLException("CL ERROR: could not create device memory for cv::Mat " + name + " [" + clDecodeErrorCode(err) + "]");
+
+	trackExternalMemory(memory, context);
+	bisUploaded = false;
+}
+
+cl_int OCLMatVariable::syncThroughMapping(cl::CommandQueue * queue, bool toDevice)
+{
+	cl_int err = CL_SUCCESS;
+	size_t rowBytes = mat.cols * mat.elemSize();
+	size_t mappedPitch = mat.step[0];
+	void* mapped = NULL;
+	cl_map_flags flags = toDevice ? CL_MAP_WRITE : CL_MAP_READ;
+
+	if (binding == MBImage)
+	{
+		cl::size_t<3> origin, region;
+		region[0] = mat.cols;
+		region[1] = mat.rows;
+		region[2] = 1;
+		size_t slicePitch = 0;
+		mapped = queue->enqueueMapImage(*(cl::Image*)memory, CL_TRUE, flags, origin, region, &mappedPitch, &slicePitch, NULL, NULL, &err);
+	}
+	else
+		mapped = queue->enqueueMapBuffer(*(cl::Buffer*)memory, CL_TRUE, flags, 0, getSize(), NULL, NULL, &err);
+
+	if (CL_SUCCESS != err)
+		return err;
+
+	//with CL_MEM_USE_HOST_PTR the mapping usually is the Mat itself
+	if (mapped != mat.data)
+	{
+		if (toDevice)
+			copyRows((unsigned char*)mapped, mappedPitch, mat.data, mat.step[0], rowBytes, mat.rows);
+		else
+			copyRows(mat.data, mat.step[0], (unsigned char*)mapped, mappedPitch, rowBytes, mat.rows);
+	}
+
+	err = queue->enqueueUnmapMemObject(*memory, mapped);
+	if (CL_SUCCESS == err && (getIsBlocking() || !toDevice))
+		err = queue->finish();
+	return err;
+}
+
+cl_int OCLMatVariable::enqueueTransfer(cl::CommandQueue * queue, bool toDevice)
+{
+	if (binding == MBImage)
+	{
+		cl::size_t<3> origin, region;
+		region[0] = mat.cols;
+		region[1] = mat.rows;
+		region[2] = 1;
+		if (toDevice)
+			return queue->enqueueWriteImage(*(cl::Image*)memory, CL_FALSE, origin, region, mat.step[0], 0, mat.data);
+		return queue->enqueueReadImage(*(cl::Image*)memory, CL_FALSE, origin, region, mat.step[0], 0, mat.data);
+	}
+
+	//the buffer has the layout of the Mat, only the bytes of each row are copied so the columns of a parent Mat beside a submatrix stay untouched
+	cl::size_t<3> origin, region;
+	region[0] = mat.cols * mat.elemSize();
+	region[1] = mat.rows;
+	region[2] = 1;
+	if (toDevice)
+		return queue->enqueueWriteBufferRect(*(cl::Buffer*)memory, CL_FALSE, origin, origin, region, mat.step[0], 0, mat.step[0], 0, mat.data);
+	return queue->enqueueReadBufferRect(*(cl::Buffer*)memory, CL_FALSE, origin, origin, region, mat.step[0], 0, mat.step[0], 0, mat.data);
+}
+
+cl_int OCLMatVariable::uploadBuffer(cl::CommandQueue * queue, bool bAllowBlocking)
+{
+	if (bisUploaded || memory == NULL || accessType == ATWrite)
+		return CL_SUCCESS;
+
+	cl_int err = bAllowBlocking ? syncThroughMapping(queue, true) : enqueueTransfer(queue, true);
+	if (CL_SUCCESS == err)
+		bisUploaded = true;
+	return err;
+}
+
+cl_int OCLMatVariable::downloadBuffer(cl::CommandQueue * queue, bool bAllowBlocking)
+{
+	if (memory == NULL || accessType == ATRead || accessType == ATReadCopy)
+		return CL_SUCCESS;
+
+	//a UMat buffer bound directly is synchronized by OpenCV
+	if (bHasUMat && mat.empty())
+		return CL_SUCCESS;
+
+	return bAllowBlocking ? syncThroughMapping(queue, false) : enqueueTransfer(queue, false);
+}
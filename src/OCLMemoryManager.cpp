@@ -0,0 +1,256 @@
+#include "OCLMemoryManager.h"
+
+std::atomic<unsigned long long> OCLMemoryManager::useClock(0);
+std::atomic<size_t> OCLMemoryManager::defaultBudget(0);
+
+namespace
+{
+	//managers by context, never destroyed since variables with static storage may release their memory after the end of main
+	std::mutex* registryLock = new std::mutex();
+	std::map<cl_context, std::shared_ptr<OCLMemoryManager>>* registry = new std::map<cl_context, std::shared_ptr<OCLMemoryManager>>();
+}
+
+OCLMemoryManager::OCLMemoryManager(const cl::Context& context)
+	: context(context), launchEpoch(0)
+{
+}
+
+OCLMemoryManager::~OCLMemoryManager()
+{
+	delete queue;
+}
+
+std::shared_ptr<OCLMemoryManager> OCLMemoryManager::getManager(cl::Context * context)
+{
+	if (context == NULL || (*context)() == NULL)
+		throw OCLException("Memory manager requested without context");
+
+	std::lock_guard<std::mutex> guard(*registryLock);
+	std::shared_ptr<OCLMemoryManager>& ret = (*registry)[(*context)()];
+	if (!ret)
+		ret.reset(new OCLMemoryManager(*context));
+	return ret;
+}
+
+void OCLMemoryManager::releaseManager(cl::Context * context)
+{
+	if (context == NULL)
+		return;
+
+	std::lock_guard<std::mutex> guard(*registryLock);
+	registry->erase((*context)());
+}
+
+void OCLMemoryManager::setDefaultBudget(size_t bytes)
+{
+	defaultBudget = bytes;
+}
+
+size_t OCLMemoryManager::getDefaultBudget()
+{
+	return defaultBudget;
+}
+
+void OCLMemoryManager::setBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	stats.budget = bytes;
+}
+
+size_t OCLMemoryManager::getBudget()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats.budget;
+}
+
+FOCLMemoryStats OCLMemoryManager::getStats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	FOCLMemoryStats ret = stats;
+	ret.allocationCount = tracked.size();
+	return ret;
+}
+
+void OCLMemoryManager::setSyncCallback(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	syncCallback = callback;
+}
+
+bool OCLMemoryManager::makeRoom(size_t bytes, OCLVariable * requester)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (stats.budget == 0)
+		return true;
+
+	bool synced = false;
+	while (stats.allocated + bytes > stats.budget)
+	{
+		OCLVariable* victim = findVictim(requester);
+		if (victim == NULL)
+		{
+			std::printf("Device memory budget exceeded, %zi of %zi bytes used and nothing left to evict\n", stats.allocated + bytes, stats.budget);
+			return false;
+		}
+
+		evict(victim, synced);
+	}
+
+	return true;
+}
+
+size_t OCLMemoryManager::evictAll()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	bool synced = false;
+	size_t ret = 0;
+	for (OCLVariable* victim = findVictim(NULL); victim != NULL; victim = findVictim(NULL))
+		ret += evict(victim, synced);
+	return ret;
+}
+
+void OCLMemoryManager::track(OCLVariable * var, size_t bytes, bool evictable)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	FOCLTrackedMemory& entry = tracked[var];
+	stats.allocated -= entry.bytes;
+	entry.bytes = bytes;
+	entry.bEvictable = evictable;
+	stats.allocated += bytes;
+	if (stats.allocated > stats.peakAllocated)
+		stats.peakAllocated = stats.allocated;
+}
+
+void OCLMemoryManager::forget(OCLVariable * var)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = tracked.find(var);
+	if (it == tracked.end())
+		return;
+
+	stats.allocated -= it->second.bytes;
+	tracked.erase(it);
+}
+
+OCLVariable * OCLMemoryManager::findVictim(OCLVariable * requester)
+{
+	OCLVariable* ret = NULL;
+	unsigned long long epoch = launchEpoch;
+	for (auto& entry : tracked)
+	{
+		OCLVariable* var = entry.first;
+		if (!entry.second.bEvictable || var == requester || var->getLastUse() > epoch || !var->isEvictable())
+			continue;
+
+		if (ret == NULL || var->getLastUse() < ret->getLastUse())
+			ret = var;
+	}
+	return ret;
+}
+
+size_t OCLMemoryManager::evict(OCLVariable * var, bool & synced)
+{
+	//launches in flight may still write the buffer
+	if (!synced && var->getAccessType() != ATRead && syncCallback)
+	{
+		syncCallback();
+		synced = true;
+	}
+
+	size_t bytes = tracked[var].bytes;
+	if (!var->evictCLMemory(getQueue()))
+		std::printf("Could not save device data of evicted variable %s\n", var->getName().c_str());
+
+	stats.allocated -= bytes;
+	stats.evictionCount++;
+	stats.evictedBytes += bytes;
+	tracked.erase(var);
+	return bytes;
+}
+
+cl::CommandQueue * OCLMemoryManager::getQueue()
+{
+	if (queue != NULL)
+		return queue;
+
+	std::vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES>();
+	queue = new cl::CommandQueue(context, devices[0]);
+	return queue;
+}
+
+cl::Buffer* OCLVariable::createManagedBuffer(cl::Context * context, size_t bytes)
+{
+	memoryManager = OCLMemoryManager::getManager(context);
+	OCLMemoryManager& manager = *memoryManager;
+	manager.makeRoom(bytes, this);
+
+	cl_int err = CL_SUCCESS;
+	cl::Buffer* ret = new cl::Buffer(*context, this->getAccessType(), bytes, NULL, &err);
+	if (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES)
+	{
+		//the budget was too optimistic, free everything possible and try once more
+		delete ret;
+		manager.evictAll();
+		ret = new cl::Buffer(*context, this->getAccessType(), bytes, NULL, &err);
+	}
+	if (CL_SUCCESS != err)
+		std::printf("CL ERROR: could not create buffer of %zi bytes for %s! [%s]\n", bytes, name.c_str(), clDecodeErrorCode(err).c_str());
+
+	manager.track(this, bytes, true);
+	bIsManaged = true;
+	touchCLMemory();
+	return ret;
+}
+
+void OCLVariable::releaseManagedBuffer(cl::Buffer *& buffer)
+{
+	if (bIsManaged)
+		forgetCLMemory();
+
+	delete buffer;
+	buffer = NULL;
+}
+
+void OCLVariable::trackExternalMemory(cl::Memory * memory, cl::Context * context)
+{
+	if (memory == NULL || (*memory)() == NULL)
+		return;
+
+	memoryManager = OCLMemoryManager::getManager(context);
+	memoryManager->track(this, memory->getInfo<CL_MEM_SIZE>(), false);
+	bIsManaged = true;
+}
+
+void OCLVariable::touchCLMemory()
+{
+	lastUse = OCLMemoryManager::nextUse();
+}
+
+void OCLVariable::forgetCLMemory()
+{
+	if (memoryManager)
+		memoryManager->forget(this);
+	bIsManaged = false;
+}
+
+void OCLVariable::beginMemoryEpoch(cl::Context * context)
+{
+	if (context != NULL)
+		OCLMemoryManager::getManager(context)->beginEpoch();
+}
+
+bool OCLVariable::evictCLMemory(cl::CommandQueue * queue)
+{
+	bool ret = true;
+	//write only variables are never uploaded, the flag of the launches decides; changed host data is newer than the device data
+	if (bDeviceWritten)
+	{
+		ret = downloadBuffer(queue) == CL_SUCCESS && queue->finish() == CL_SUCCESS;
+	}
+
+	dropCLMemory();
+	bisUploaded = false;
+	bDeviceWritten = false;
+	bIsManaged = false;
+	return ret;
+}
@@ -0,0 +1,158 @@
+#include "OCLPixelIntegrator.h"
+#include <string.h>
+
+OCLPixelIntegrator::OCLPixelIntegrator(int width, int height, bool weightByToT, OpenCLExecutor& executor)
+	: executor(executor),
+	image(NULL, (size_t)width * height, "integratedImage", true, ATReadWrite),
+	hitCountArg((cl_ulong)0, "hitCount"),
+	addFromArg((cl_ulong)0, "addFrom"),
+	addToArg((cl_ulong)0, "addTo"),
+	subFromArg((cl_ulong)0, "subFrom"),
+	subToArg((cl_ulong)0, "subTo"),
+	useToTArg((cl_int)(weightByToT ? 1 : 0), "useToT"),
+	widthArg((cl_int)width, "width"),
+	heightArg((cl_int)height, "height")
+{
+	cl::Device device = executor.getDefaultDevice();
+	FOCLDeviceInfos infos(device);
+
+	//the tile histogram lives in local memory, two groups per compute unit should fit at once
+	tileSize = MaxTileSize;
+	while (tileSize > MinTileSize && (cl_ulong)(tileSize * tileSize * sizeof(cl_int)) > infos.maxDeviceMemory / 2)
+		tileSize /= 2;
+
+	//one program per sensor geometry, integrators of the same geometry share it
+	FOCLKernelConstants constants;
+	constants.set("TILE_SIZE", tileSize).set("SENSOR_WIDTH", width).set("SENSOR_HEIGHT", height);
+	integrationKernel = loadOCLKernelSpecialized(PixelIntegration, "integrate_hits", constants);
+
+	workGroupSize = (infos.maxWorkGroupSize < 256) ? infos.maxWorkGroupSize : 256;
+	FOCLKernelResourceInfo resources = executor.getKernelResources(integrationKernel);
+	if (resources.bIsValid && resources.maxWorkGroupSize < workGroupSize)
+		workGroupSize = resources.maxWorkGroupSize;
+	tileCount = (size_t)((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+
+	//keep every compute unit busy with a few groups, each tile gets at least one group
+	groupsPerTile = (infos.maxComputeUnits * 4) / tileCount;
+	if (groupsPerTile == 0)
+		groupsPerTile = 1;
+
+	integrationKernel.globalThreadCount = cl::NDRange(groupsPerTile * workGroupSize, tileCount);
+	integrationKernel.localThreadCount = cl::NDRange(workGroupSize, 1);
+
+	reset();
+}
+
+OCLPixelIntegrator::~OCLPixelIntegrator()
+{
+	executor.ReleaseKernel(integrationKernel);
+}
+
+void OCLPixelIntegrator::integrate(OCLVariable* hits, cl_ulong startTime, cl_ulong endTime, size_t hitCount)
+{
+	reset();
+	runIntegration(hits, hitCount, startTime, endTime, 0, 0);
+
+	windowStart = startTime;
+	windowEnd = endTime;
+	bHasWindow = true;
+}
+
+void OCLPixelIntegrator::slideWindow(OCLVariable* hits, cl_ulong startTime, cl_ulong endTime, size_t hitCount)
+{
+	//only forward moving, overlapping windows can be updated incrementally
+	if (!bHasWindow || startTime < windowStart || endTime < windowEnd || startTime >= windowEnd)
+	{
+		integrate(hits, startTime, endTime, hitCount);
+		return;
+	}
+
+	if (startTime == windowStart && endTime == windowEnd)
+		return;
+
+	runIntegration(hits, hitCount, windowEnd, endTime, windowStart, startTime);
+
+	windowStart = startTime;
+	windowEnd = endTime;
+}
+
+void OCLPixelIntegrator::reset()
+{
+	memset(image.getValue(), 0, image.getSize());
+	image.setVariableChanged(true);
+	bHasWindow = false;
+}
+
+void OCLPixelIntegrator::setWeightByToT(bool val)
+{
+	useToTArg.value[0] = val ? 1 : 0;
+	bHasWindow = false;
+}
+
+void OCLPixelIntegrator::setBuildProfile(EOCLBuildProfile profile)
+{
+	if (integrationKernel.buildProfile == profile)
+		return;
+
+	executor.ReleaseKernel(integrationKernel);
+	integrationKernel.context = NULL;
+	integrationKernel.buildProfile = profile;
+}
+
+std::vector<FOCLProfileBenchmark> OCLPixelIntegrator::benchmarkProfiles(OCLVariable* hits, cl_ulong startTime, cl_ulong endTime, size_t hitCount, int repetitions)
+{
+	std::vector<FOCLProfileBenchmark> ret;
+	std::vector<cl_int> reference;
+	EOCLBuildProfile previous = integrationKernel.buildProfile;
+
+	for (EOCLBuildProfile profile : { BPStandard, BPPrecise, BPFast })
+	{
+		FOCLProfileBenchmark result;
+		result.profile = profile;
+		result.buildOptions = executor.getProfileBuildOptions(profile);
+		setBuildProfile(profile);
+
+		//the first run builds the program
+		integrate(hits, startTime, endTime, hitCount);
+		OCLDynamicTypedBuffer<cl_int>& img = getImage(true);
+		std::vector<cl_int> current(img.getTypedValue(), img.getTypedValue() + img.getBufferLength());
+		if (reference.empty())
+			reference = current;
+		result.bMatchesReference = (current == reference);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < repetitions; i++)
+			integrate(hits, startTime, endTime, hitCount);
+		auto end = std::chrono::high_resolution_clock::now();
+		result.milliseconds = std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+
+		ret.push_back(result);
+	}
+
+	setBuildProfile(previous);
+	reset();
+	return ret;
+}
+
+OCLDynamicTypedBuffer<cl_int>& OCLPixelIntegrator::getImage(bool download)
+{
+	if (download && executor.runsKernel(integrationKernel))
+		executor.GetResultOf(integrationKernel, &image, true);
+
+	return image;
+}
+
+void OCLPixelIntegrator::runIntegration(OCLVariable* hits, size_t hitCount, cl_ulong addFrom, cl_ulong addTo, cl_ulong subFrom, cl_ulong subTo)
+{
+	if (hitCount == 0)
+		hitCount = hits->getSize() / sizeof(FTpxPixel);
+
+	hitCountArg.value[0] = hitCount;
+	addFromArg.value[0] = addFrom;
+	addToArg.value[0] = addTo;
+	subFromArg.value[0] = subFrom;
+	subToArg.value[0] = subTo;
+
+	integrationKernel.Arguments = { hits, &hitCountArg, &addFromArg, &addToArg, &subFromArg, &subToArg, &useToTArg, &widthArg, &heightArg, &image };
+	executor.RunKernel(integrationKernel);
+}
@@ -0,0 +1,200 @@
+#include "OCLPrimitives.h"
+#include <string.h>
+
+//scratch slots, scan levels use the slots behind ScratchScanLevels
+#define ScratchReducePartials 0
+#define ScratchScanLevels 1
+
+OCLPrimitives::OCLPrimitives(OpenCLExecutor& executor)
+	: executor(executor),
+	flags(NULL, 0, "compactFlags"),
+	positions(NULL, 0, "compactPositions"),
+	total(NULL, 1, "compactTotal")
+{
+	cl::Device device = executor.getDefaultDevice();
+	FOCLDeviceInfos infos(device);
+
+	//the reduction tree needs a power of two
+	workGroupSize = 1;
+	while (workGroupSize * 2 <= infos.maxWorkGroupSize && workGroupSize * 2 <= 256)
+		workGroupSize *= 2;
+
+	maxGroups = infos.maxComputeUnits * 8;
+	if (maxGroups == 0)
+		maxGroups = 1;
+	localMemorySize = (size_t)infos.maxDeviceMemory;
+}
+
+OCLPrimitives::~OCLPrimitives()
+{
+	for (auto& itr : kernels)
+		executor.ReleaseKernel(itr.second);
+}
+
+bool OCLPrimitives::downloadResult(OCLVariable* var)
+{
+	if (lastKernel == NULL)
+		return false;
+
+	return executor.GetResultOf(*lastKernel, var, true);
+}
+
+FOCLKernel& OCLPrimitives::getKernel(const std::string& mainMethodName, const FOCLTypeDesc& type, EOCLReduceOp op, size_t localBins, const std::string& predicate)
+{
+	std::string key = mainMethodName + "|" + type.name + "|" + std::to_string(op) + "|" + std::to_string(localBins) + "|" + predicate;
+	auto itr = kernels.find(key);
+	if (itr != kernels.end())
+		return itr->second;
+
+	std::vector<std::pair<std::string, std::string>> constants = {
+		{ "T_MAX", type.maxValue },
+		{ "T_LOWEST", type.lowestValue },
+		{ "T_IS_FLOAT", type.isFloatingPoint ? "1" : "0" },
+		{ "T", type.name },
+		{ "OP", std::to_string(op) },
+		{ "WORK_GROUP_SIZE", std::to_string(workGroupSize) },
+		{ "LOCAL_BINS", std::to_string(localBins) },
+		{ "PREDICATE", predicate }
+	};
+
+	FOCLKernel& kernel = kernels[key];
+	kernel = loadOCLKernelAndConstants(Primitives, mainMethodName, constants);
+	kernel.localThreadCount = cl::NDRange(workGroupSize);
+	return kernel;
+}
+
+OCLDynamicTypedBuffer<cl_uchar>* OCLPrimitives::getScratch(size_t idx, size_t bytes)
+{
+	while (scratch.size() <= idx)
+		scratch.push_back(std::unique_ptr<OCLDynamicTypedBuffer<cl_uchar>>(new OCLDynamicTypedBuffer<cl_uchar>(NULL, 0, "primitiveScratch" + std::to_string(scratch.size()))));
+
+	OCLDynamicTypedBuffer<cl_uchar>* buffer = scratch[idx].get();
+	if (buffer->getBufferLength() < bytes)
+		buffer->resizeBuffer(bytes);
+
+	buffer->setVariableChanged(false);
+	return buffer;
+}
+
+void OCLPrimitives::runReduce(OCLVariable* in, OCLVariable* result, const FOCLTypeDesc& type, EOCLReduceOp op, size_t count)
+{
+	FOCLKernel& kernel = getKernel("reduce_blocks", type, op);
+	result->setVariableChanged(false);
+
+	size_t groups = (count + workGroupSize - 1) / workGroupSize;
+	if (groups > maxGroups)
+		groups = maxGroups;
+	if (groups == 0)
+		groups = 1;
+
+	OCLDynamicTypedBuffer<cl_uchar>* partials = getScratch(ScratchReducePartials, groups * type.size);
+	OCLTypedVariable<cl_ulong, ASPrivate> countArg((cl_ulong)count, "count");
+	OCLTypedVariable<cl_ulong, ASPrivate> partialCountArg((cl_ulong)groups, "partialCount");
+
+	//first pass leaves one partial per group, the second reduces the partials in a single group
+	kernel.globalThreadCount = cl::NDRange(groups * workGroupSize);
+	kernel.Arguments = { in, &countArg, partials };
+	executor.RunKernel(kernel);
+
+	kernel.globalThreadCount = cl::NDRange(workGroupSize);
+	kernel.Arguments = { partials, &partialCountArg, result };
+	executor.RunKernel(kernel);
+
+	lastKernel = &kernel;
+	executor.GetResultOf(kernel, result, true);
+}
+
+void OCLPrimitives::runScan(OCLVariable* in, OCLVariable* out, const FOCLTypeDesc& type, bool inclusive, size_t count, size_t level)
+{
+	FOCLKernel& scanKernel = getKernel("scan_blocks", type);
+	FOCLKernel& addKernel = getKernel("scan_add_offsets", type);
+
+	size_t blockSize = workGroupSize * ScanItemsPerWorkItem;
+	size_t blocks = (count + blockSize - 1) / blockSize;
+	if (blocks == 0)
+		return;
+
+	OCLDynamicTypedBuffer<cl_uchar>* blockSums = getScratch(ScratchScanLevels + level, blocks * type.size);
+	OCLTypedVariable<cl_ulong, ASPrivate> countArg((cl_ulong)count, "count");
+	OCLTypedVariable<cl_int, ASPrivate> inclusiveArg((cl_int)(inclusive ? 1 : 0), "inclusive");
+
+	scanKernel.globalThreadCount = cl::NDRange(blocks * workGroupSize);
+	scanKernel.Arguments = { in, out, &countArg, &inclusiveArg, blockSums };
+	executor.RunKernel(scanKernel);
+	lastKernel = &scanKernel;
+
+	if (blocks == 1)
+		return;
+
+	//scan the block sums exclusively and add them onto every block
+	runScan(blockSums, blockSums, type, false, blocks, level + 1);
+
+	OCLTypedVariable<cl_ulong, ASPrivate> addCountArg((cl_ulong)count, "count");
+	addKernel.globalThreadCount = cl::NDRange(blocks * workGroupSize);
+	addKernel.Arguments = { out, &addCountArg, blockSums };
+	executor.RunKernel(addKernel);
+	lastKernel = &addKernel;
+}
+
+void OCLPrimitives::runHistogram(OCLVariable* in, OCLDynamicTypedBuffer<cl_uint>* bins, OCLVariable* minValue, OCLVariable* maxValue, const FOCLTypeDesc& type, size_t count)
+{
+	size_t binCount = bins->getBufferLength();
+	if (binCount == 0)
+		return;
+
+	//bins are kept in local memory as long as they use at most half of it
+	size_t localBins = (binCount * sizeof(cl_uint) * 2 <= localMemorySize) ? binCount : 0;
+	FOCLKernel& kernel = getKernel("histogram", type, ROSum, localBins);
+
+	memset(bins->getValue(), 0, bins->getSize());
+	bins->setVariableChanged(true);
+
+	size_t groups = (count + workGroupSize - 1) / workGroupSize;
+	if (groups > maxGroups)
+		groups = maxGroups;
+	if (groups == 0)
+		groups = 1;
+
+	OCLTypedVariable<cl_ulong, ASPrivate> countArg((cl_ulong)count, "count");
+	OCLTypedVariable<cl_uint, ASPrivate> binCountArg((cl_uint)binCount, "binCount");
+
+	kernel.globalThreadCount = cl::NDRange(groups * workGroupSize);
+	kernel.Arguments = { in, &countArg, minValue, maxValue, &binCountArg, bins };
+	executor.RunKernel(kernel);
+	lastKernel = &kernel;
+}
+
+size_t OCLPrimitives::runCompact(OCLVariable* in, OCLVariable* out, const FOCLTypeDesc& type, const std::string& predicate, size_t count)
+{
+	if (count == 0)
+		return 0;
+
+	FOCLKernel& flagKernel = getKernel("compact_flags", type, ROSum, 0, predicate);
+	FOCLKernel& scatterKernel = getKernel("compact_scatter", type);
+
+	if (flags.getBufferLength() < count)
+	{
+		flags.resizeBuffer(count);
+		positions.resizeBuffer(count);
+	}
+	flags.setVariableChanged(false);
+	positions.setVariableChanged(false);
+	total.setVariableChanged(false);
+
+	size_t groups = (count + workGroupSize - 1) / workGroupSize;
+	OCLTypedVariable<cl_ulong, ASPrivate> countArg((cl_ulong)count, "count");
+
+	flagKernel.globalThreadCount = cl::NDRange(groups * workGroupSize);
+	flagKernel.Arguments = { in, &countArg, &flags };
+	executor.RunKernel(flagKernel);
+
+	runScan(&flags, &positions, FOCLTypeInfo<cl_uint>::get(), false, count);
+
+	scatterKernel.globalThreadCount = cl::NDRange(groups * workGroupSize);
+	scatterKernel.Arguments = { in, &countArg, &flags, &positions, out, &total };
+	executor.RunKernel(scatterKernel);
+	lastKernel = &scatterKernel;
+
+	executor.GetResultOf(scatterKernel, &total, true);
+	return total[0];
+}
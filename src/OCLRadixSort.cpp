@@ -0,0 +1,140 @@
+#include "OCLRadixSort.h"
+
+static std::string clTypeNameOfSize(size_t size)
+{
+	switch (size)
+	{
+		case 1: return "uchar";
+		case 2: return "ushort";
+		case 4: return "uint";
+		case 8: return "ulong";
+		case 16: return "uint4";
+	}
+
+	throw OCLException("No OpenCL type for size " + std::to_string(size));
+}
+
+OCLRadixSort::OCLRadixSort(OpenCLExecutor& executor)
+	: executor(executor),
+	keyTemp(NULL, 0, "radixKeyTemp"),
+	valueTemp(NULL, 0, "radixValueTemp"),
+	groupHist(NULL, 0, "radixGroupHist"),
+	countArg((cl_ulong)0, "count"),
+	shiftArg((cl_uint)0, "shift"),
+	histCountArg((cl_ulong)0, "histCount")
+{
+	cl::Device device = executor.getDefaultDevice();
+	FOCLDeviceInfos infos(device);
+	workGroupSize = (infos.maxWorkGroupSize < 256) ? infos.maxWorkGroupSize : 256;
+}
+
+OCLRadixSort::~OCLRadixSort()
+{
+	for (auto& itr : kernelSets)
+	{
+		executor.ReleaseKernel(itr.second.histogram);
+		executor.ReleaseKernel(itr.second.scan);
+		executor.ReleaseKernel(itr.second.scatter);
+	}
+}
+
+FOCLRadixSortKernels& OCLRadixSort::getKernels(size_t keySize, size_t valueSize)
+{
+	std::pair<size_t, size_t> key(keySize, valueSize);
+	auto itr = kernelSets.find(key);
+	if (itr != kernelSets.end())
+		return itr->second;
+
+	std::vector<std::pair<std::string, std::string>> constants = {
+		{ "KEY_TYPE", clTypeNameOfSize(keySize) },
+		{ "VALUE_TYPE", (valueSize == 0) ? "uchar" : clTypeNameOfSize(valueSize) },
+		{ "HAS_VALUES", (valueSize == 0) ? "0" : "1" },
+		{ "WORK_GROUP_SIZE", std::to_string(workGroupSize) }
+	};
+
+	FOCLRadixSortKernels& kernels = kernelSets[key];
+	kernels.histogram = loadOCLKernelAndConstants(RadixSort, "radix_histogram", constants);
+	kernels.scan = loadOCLKernelAndConstants(RadixSort, "radix_scan", constants);
+	kernels.scatter = loadOCLKernelAndConstants(RadixSort, "radix_scatter", constants);
+	kernels.scan.globalThreadCount = cl::NDRange(workGroupSize);
+	kernels.scan.localThreadCount = cl::NDRange(workGroupSize);
+
+	return kernels;
+}
+
+void OCLRadixSort::runSort(OCLVariable* keys, OCLVariable* values, size_t count, int keyBits, size_t keySize, size_t valueSize)
+{
+	if (count <= 1)
+		return;
+
+	FOCLRadixSortKernels& kernels = getKernels(keySize, valueSize);
+	lastKernels = &kernels;
+	size_t groups = (count + workGroupSize - 1) / workGroupSize;
+
+	//temporaries live on the CL device only
+	if (keyTemp.getBufferLength() < count * keySize)
+		keyTemp.resizeBuffer(count * keySize);
+	if (valueSize > 0 && valueTemp.getBufferLength() < count * valueSize)
+		valueTemp.resizeBuffer(count * valueSize);
+	if (groupHist.getBufferLength() < groups * 16)
+		groupHist.resizeBuffer(groups * 16);
+	keyTemp.setVariableChanged(false);
+	valueTemp.setVariableChanged(false);
+	groupHist.setVariableChanged(false);
+
+	countArg.value[0] = count;
+	histCountArg.value[0] = groups * 16;
+
+	cl::NDRange global(groups * workGroupSize);
+	cl::NDRange local(workGroupSize);
+	kernels.histogram.globalThreadCount = global;
+	kernels.histogram.localThreadCount = local;
+	kernels.scatter.globalThreadCount = global;
+	kernels.scatter.localThreadCount = local;
+
+	OCLVariable* keysIn = keys;
+	OCLVariable* keysOut = &keyTemp;
+	OCLVariable* valuesIn = (values != NULL) ? values : keys;
+	OCLVariable* valuesOut = (values != NULL) ? (OCLVariable*)&valueTemp : &keyTemp;
+
+	int passes = (keyBits + 3) / 4;
+	for (int pass = 0; pass < passes; pass++)
+	{
+		shiftArg.value[0] = pass * 4;
+
+		kernels.histogram.Arguments = { keysIn, &countArg, &shiftArg, &groupHist };
+		executor.RunKernel(kernels.histogram);
+
+		kernels.scan.Arguments = { &groupHist, &histCountArg };
+		executor.RunKernel(kernels.scan);
+
+		kernels.scatter.Arguments = { keysIn, valuesIn, &countArg, &shiftArg, &groupHist, keysOut, valuesOut };
+		executor.RunKernel(kernels.scatter);
+
+		std::swap(keysIn, keysOut);
+		if (values != NULL)
+			std::swap(valuesIn, valuesOut);
+	}
+
+	//odd pass count leaves the result in the temporaries
+	if (keysIn != keys)
+	{
+		FOCLKernelGroup* g = executor.getWorkingGroupOfKernel(kernels.scatter);
+		cl_int err = g->queue->enqueueCopyBuffer(*(cl::Buffer*)keysIn->getCLMemoryObject(NULL), *(cl::Buffer*)keys->getCLMemoryObject(NULL), 0, 0, count * keySize);
+		if (values != NULL && err == CL_SUCCESS)
+			err = g->queue->enqueueCopyBuffer(*(cl::Buffer*)valuesIn->getCLMemoryObject(NULL), *(cl::Buffer*)values->getCLMemoryObject(NULL), 0, 0, count * valueSize);
+		if (err == CL_SUCCESS)
+			err = g->queue->finish();
+
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: could not copy sorted radix data! [" + clDecodeErrorCode(err) + "]");
+	}
+}
+
+bool OCLRadixSort::downloadResult(OCLVariable* var)
+{
+	if (lastKernels == NULL)
+		return false;
+
+	return executor.GetResultOf(lastKernels->scatter, var, true);
+}
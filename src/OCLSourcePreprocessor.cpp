@@ -0,0 +1,216 @@
+#include "OCLSourcePreprocessor.h"
+#include <algorithm>
+#include <sstream>
+
+OCLSourcePreprocessor::OCLSourcePreprocessor()
+{
+	CREATEMUTEX(LOCK);
+	std::string cwd = fs::current_path().string();
+	searchPaths.push_back(cwd + "/opencl/");
+	searchPaths.push_back(cwd + "/opencl/include/");
+}
+
+OCLSourcePreprocessor::~OCLSourcePreprocessor()
+{
+	DESTROYMUTEX(LOCK);
+}
+
+OCLSourcePreprocessor & OCLSourcePreprocessor::getPreprocessor()
+{
+	static OCLSourcePreprocessor preprocessor;
+	return preprocessor;
+}
+
+void OCLSourcePreprocessor::addSearchPath(std::string path)
+{
+	ACQUIRE_MUTEX(LOCK);
+	searchPaths.push_back(path);
+	expanded.clear();
+	RELEASE_MUTEX(LOCK);
+}
+
+void OCLSourcePreprocessor::setSearchPaths(std::vector<std::string> paths)
+{
+	ACQUIRE_MUTEX(LOCK);
+	searchPaths = paths;
+	expanded.clear();
+	RELEASE_MUTEX(LOCK);
+}
+
+std::vector<std::string> OCLSourcePreprocessor::getSearchPaths()
+{
+	ACQUIRE_MUTEX(LOCK);
+	std::vector<std::string> ret = searchPaths;
+	RELEASE_MUTEX(LOCK);
+	return ret;
+}
+
+FOCLPreprocessedSource OCLSourcePreprocessor::expand(std::string file)
+{
+	ACQUIRE_MUTEX(LOCK);
+	try
+	{
+		std::string path = resolve(file, "");
+		if (path.empty())
+			throw OCLException("Could not find cl file: " + file);
+
+		auto it = expanded.find(path);
+		if (it != expanded.end() && isUpToDate(it->second))
+		{
+			FOCLPreprocessedSource ret = it->second;
+			RELEASE_MUTEX(LOCK);
+			return ret;
+		}
+
+		FOCLPreprocessedSource ret;
+		std::set<std::string> onceFiles;
+		std::vector<std::string> stack;
+		expandInto(path, ret, onceFiles, stack);
+		expanded[path] = ret;
+
+		RELEASE_MUTEX(LOCK);
+		return ret;
+	}
+	catch (...)
+	{
+		RELEASE_MUTEX(LOCK);
+		throw;
+	}
+}
+
+void OCLSourcePreprocessor::clearCache()
+{
+	ACQUIRE_MUTEX(LOCK);
+	files.clear();
+	expanded.clear();
+	RELEASE_MUTEX(LOCK);
+}
+
+std::string OCLSourcePreprocessor::resolve(const std::string & name, const std::string & includingDir)
+{
+	std::error_code err;
+	if (fs::path(name).is_absolute())
+		return fs::is_regular_file(name, err) ? name : "";
+
+	if (!includingDir.empty() && fs::is_regular_file(fs::path(includingDir) / name, err))
+		return (fs::path(includingDir) / name).lexically_normal().string();
+
+	for (const std::string& dir : searchPaths)
+	{
+		if (fs::is_regular_file(fs::path(dir) / name, err))
+			return (fs::path(dir) / name).lexically_normal().string();
+	}
+
+	return "";
+}
+
+const OCLSourcePreprocessor::FOCLSourceFile & OCLSourcePreprocessor::readFile(const std::string & path)
+{
+	std::error_code err;
+	fs::file_time_type writeTime = fs::last_write_time(path, err);
+
+	auto it = files.find(path);
+	if (it != files.end() && it->second.writeTime == writeTime)
+		return it->second;
+
+	std::ifstream t(path);
+	if (!t.good())
+		throw OCLException("Could not read cl file: " + path);
+
+	FOCLSourceFile file;
+	file.writeTime = writeTime;
+	FOCLSourceSegment segment;
+
+	//directives are only recognized at the start of a line
+	std::string line;
+	while (std::getline(t, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		size_t pos = line.find_first_not_of(" \t");
+		if (pos == std::string::npos || line[pos] != '#')
+		{
+			segment.text += line + "\n";
+			continue;
+		}
+
+		std::istringstream directive(line.substr(pos + 1));
+		std::string keyword, argument;
+		directive >> keyword >> argument;
+
+		if (keyword == "pragma" && argument == "once")
+		{
+			file.pragmaOnce = true;
+			segment.text += "\n";
+		}
+		else if (keyword == "include" && argument.size() > 2 && (argument.front() == '"' || argument.front() == '<'))
+		{
+			segment.include = argument.substr(1, argument.find_first_of("\">", 1) - 1);
+			file.segments.push_back(segment);
+			segment = FOCLSourceSegment();
+		}
+		else
+			segment.text += line + "\n";
+	}
+	file.segments.push_back(segment);
+
+	files[path] = file;
+	return files[path];
+}
+
+bool OCLSourcePreprocessor::isUpToDate(const FOCLPreprocessedSource & source)
+{
+	//the file cache may already be refreshed by the expansion of another source sharing the dependency
+	std::error_code err;
+	if (source.dependencyTimes.size() != source.dependencies.size())
+		return false;
+
+	for (size_t i = 0; i < source.dependencies.size(); i++)
+	{
+		if (source.dependencyTimes[i] != fs::last_write_time(source.dependencies[i], err))
+			return false;
+	}
+	return true;
+}
+
+void OCLSourcePreprocessor::expandInto(const std::string & path, FOCLPreprocessedSource & out, std::set<std::string>& onceFiles, std::vector<std::string>& stack)
+{
+	if (std::find(stack.begin(), stack.end(), path) != stack.end())
+		throw OCLException("Cyclic cl include of " + path);
+
+	const FOCLSourceFile& file = readFile(path);
+	if (file.pragmaOnce && !onceFiles.insert(path).second)
+		return;
+
+	if (std::find(out.dependencies.begin(), out.dependencies.end(), path) == out.dependencies.end())
+	{
+		out.dependencies.push_back(path);
+		out.dependencyTimes.push_back(file.writeTime);
+	}
+
+	stack.push_back(path);
+	std::string dir = fs::path(path).parent_path().string();
+	for (const FOCLSourceSegment& segment : file.segments)
+	{
+		out.source += segment.text;
+		if (segment.include.empty())
+			continue;
+
+		std::string includePath = resolve(segment.include, dir);
+		if (includePath.empty())
+			throw OCLException("Could not find cl include file: " + segment.include + " included by " + path);
+
+		expandInto(includePath, out, onceFiles, stack);
+		out.source += "\n";
+	}
+	stack.pop_back();
+}
+
+#ifndef __USE_COMPILETIMERESSOURCES__
+FOCLKernel loadOCLKernel_helper(std::string name, std::string mainMethodName)
+{
+	FOCLPreprocessedSource source = OCLSourcePreprocessor::getPreprocessor().expand(name + ".cl");
+	return FOCLKernel(mainMethodName, source.source);
+}
+#endif
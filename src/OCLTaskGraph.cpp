@@ -0,0 +1,194 @@
+#include "OCLTaskGraph.h"
+
+OCLTaskGraph::OCLTaskGraph(OpenCLExecutor& executor, OCLThreadPool& pool)
+	: executor(executor), pool(pool)
+{
+}
+
+OCLTaskGraph::~OCLTaskGraph()
+{
+	wait();
+}
+
+size_t OCLTaskGraph::addHostTask(std::function<void()> task, std::vector<size_t> dependencies)
+{
+	if (bIsRunning)
+		throw OCLException("Can't add tasks to a running task graph!");
+
+	FOCLTaskNode node;
+	node.task = task;
+	node.dependencyCount = dependencies.size();
+	nodes.push_back(node);
+
+	size_t id = nodes.size() - 1;
+	for (size_t dep : dependencies)
+	{
+		if (dep >= id)
+			throw OCLException("Task graph dependency on unknown task!");
+		nodes[dep].successors.push_back(id);
+	}
+	return id;
+}
+
+size_t OCLTaskGraph::addKernel(FOCLKernel & kernel, std::vector<size_t> dependencies, std::vector<OCLVariable*> downloads)
+{
+	size_t id = addHostTask(std::function<void()>(), dependencies);
+	nodes[id].kernel = &kernel;
+	nodes[id].downloads = downloads;
+	return id;
+}
+
+void OCLTaskGraph::run()
+{
+	std::vector<size_t> ready;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (bIsRunning)
+			throw OCLException("Task graph is already running!");
+
+		finishedCount = 0;
+		failedCount = 0;
+		bIsRunning = !nodes.empty();
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			nodes[i].remaining = nodes[i].dependencyCount;
+			nodes[i].bDependencyFailed = false;
+			if (nodes[i].remaining == 0)
+				ready.push_back(i);
+		}
+	}
+
+	for (size_t node : ready)
+		schedule(node);
+}
+
+void OCLTaskGraph::wait()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	finishedChanged.wait(guard, [this]() { return !bIsRunning; });
+}
+
+bool OCLTaskGraph::waitFor(unsigned int milliseconds)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	return finishedChanged.wait_for(guard, std::chrono::milliseconds(milliseconds), [this]() { return !bIsRunning; });
+}
+
+bool OCLTaskGraph::isFinished()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return !bIsRunning;
+}
+
+size_t OCLTaskGraph::getFailedCount()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return failedCount;
+}
+
+void OCLTaskGraph::schedule(size_t node)
+{
+	pool.enqueue([this, node]() { execute(node); });
+}
+
+void OCLTaskGraph::execute(size_t node)
+{
+	FOCLTaskNode& n = nodes[node];
+	if (n.bDependencyFailed)
+	{
+		complete(node, false);
+		return;
+	}
+
+	if (n.kernel == NULL)
+	{
+		bool success = true;
+		try
+		{
+			if (n.task)
+				n.task();
+		}
+		catch (std::exception& e)
+		{
+			std::printf("Task graph task %zi failed: %s\n", node, e.what());
+			success = false;
+		}
+		catch (...)
+		{
+			std::printf("Task graph task %zi failed with an unknown exception\n", node);
+			success = false;
+		}
+		complete(node, success);
+		return;
+	}
+
+	try
+	{
+		std::vector<FOCLKernel*> kernels = { n.kernel };
+		n.event = executor.RunBatch(kernels, n.downloads, NULL, false);
+	}
+	catch (std::exception& e)
+	{
+		std::printf("Task graph kernel %s failed: %s\n", n.kernel->mainMethodName.c_str(), e.what());
+		complete(node, false);
+		return;
+	}
+	catch (...)
+	{
+		std::printf("Task graph kernel %s failed with an unknown exception\n", n.kernel->mainMethodName.c_str());
+		complete(node, false);
+		return;
+	}
+
+	FOCLCallbackData* data = new FOCLCallbackData{ this, node };
+	cl_int err = n.event.setCallback(CL_COMPLETE, &OCLTaskGraph::onKernelComplete, data);
+	if (CL_SUCCESS != err)
+	{
+		delete data;
+		err = n.event.wait();
+		complete(node, CL_SUCCESS == err);
+	}
+}
+
+void CL_CALLBACK OCLTaskGraph::onKernelComplete(cl_event event, cl_int status, void * userData)
+{
+	FOCLCallbackData* data = (FOCLCallbackData*)userData;
+	OCLTaskGraph* graph = data->graph;
+	size_t node = data->node;
+	delete data;
+
+	//the driver thread only releases the successors, they run on the pool
+	if (status < 0)
+		std::printf("Task graph kernel %s failed: %s\n", graph->nodes[node].kernel->mainMethodName.c_str(), clDecodeErrorCode(status).c_str());
+	graph->complete(node, status >= 0);
+}
+
+void OCLTaskGraph::complete(size_t node, bool success)
+{
+	std::vector<size_t> ready;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (size_t succ : nodes[node].successors)
+		{
+			if (!success)
+				nodes[succ].bDependencyFailed = true;
+			if (--nodes[succ].remaining == 0)
+				ready.push_back(succ);
+		}
+
+		finishedCount++;
+		if (!success)
+			failedCount++;
+
+		//the graph may be destroyed as soon as the lock is released
+		if (finishedCount == nodes.size())
+		{
+			bIsRunning = false;
+			finishedChanged.notify_all();
+			return;
+		}
+	}
+
+	for (size_t succ : ready)
+		schedule(succ);
+}
@@ -0,0 +1,148 @@
+#include "OCLThreadPool.h"
+#include <stdio.h>
+#include <exception>
+
+namespace
+{
+	//pool and deque of the worker running on this thread
+	thread_local OCLThreadPool* currentPool = NULL;
+	thread_local size_t currentWorker = 0;
+}
+
+OCLThreadPool::OCLThreadPool(size_t threadCount)
+	: nextQueue(0), stealCount(0)
+{
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+
+	for (size_t i = 0; i < threadCount; i++)
+		queues.push_back(std::unique_ptr<FOCLWorkerQueue>(new FOCLWorkerQueue()));
+
+	for (size_t i = 0; i < threadCount; i++)
+		workers.push_back(std::thread(&OCLThreadPool::workerLoop, this, i));
+}
+
+OCLThreadPool::~OCLThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		bIsStopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+OCLThreadPool & OCLThreadPool::getThreadPool()
+{
+	static OCLThreadPool pool;
+	return pool;
+}
+
+OCLThreadPool & OCLThreadPool::getBuildPool()
+{
+	static OCLThreadPool pool;
+	return pool;
+}
+
+void OCLThreadPool::enqueue(std::function<void()> task)
+{
+	size_t index = isWorkerThread() ? currentWorker : nextQueue++ % queues.size();
+	{
+		std::lock_guard<std::mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(task);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queuedTasks++;
+		pendingTasks++;
+	}
+	taskAvailable.notify_one();
+}
+
+void OCLThreadPool::waitIdle()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this]() { return pendingTasks == 0; });
+}
+
+bool OCLThreadPool::isWorkerThread()
+{
+	return currentPool == this;
+}
+
+std::function<void()> OCLThreadPool::takeTask(size_t index)
+{
+	//a reservation guarantees a task in one of the deques, rescan if others took the ones seen
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> guard(queues[index]->lock);
+			if (!queues[index]->tasks.empty())
+			{
+				std::function<void()> task = queues[index]->tasks.back();
+				queues[index]->tasks.pop_back();
+				return task;
+			}
+		}
+
+		for (size_t i = 1; i < queues.size(); i++)
+		{
+			FOCLWorkerQueue& victim = *queues[(index + i) % queues.size()];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (!victim.tasks.empty())
+			{
+				std::function<void()> task = victim.tasks.front();
+				victim.tasks.pop_front();
+				stealCount++;
+				return task;
+			}
+		}
+
+		std::this_thread::yield();
+	}
+}
+
+void OCLThreadPool::workerLoop(size_t index)
+{
+	currentPool = this;
+	currentWorker = index;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			taskAvailable.wait(guard, [this]() { return bIsStopping || queuedTasks > 0; });
+			if (queuedTasks == 0)
+				return;
+
+			queuedTasks--;
+		}
+
+		std::function<void()> task = takeTask(index);
+		try
+		{
+			task();
+		}
+		catch (std::exception& e)
+		{
+			std::printf("Uncaught exception in pool task: %s\n", e.what());
+		}
+		catch (...)
+		{
+			//the worker has to survive, otherwise wait() never sees the pool idle again
+			std::printf("Uncaught unknown exception in pool task\n");
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			pendingTasks--;
+			if (pendingTasks == 0)
+				idle.notify_all();
+		}
+	}
+}
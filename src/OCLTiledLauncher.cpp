@@ -0,0 +1,257 @@
+#include "OCLTiledLauncher.h"
+#include <algorithm>
+
+OCLTiledLauncher::OCLTiledLauncher(FOCLKernel& kernel, OpenCLExecutor& executor)
+	: executor(executor), kernel(kernel)
+{
+	if (!executor.InitKernel(kernel))
+		throw OCLException("Could not initialize tiled kernel " + kernel.mainMethodName);
+
+	device = executor.getDefaultDevice();
+	cl::Context context = executor.getContext();
+	clKernel = cl::Kernel(kernel.program, kernel.mainMethodName.c_str());
+	uploadQueue = cl::CommandQueue(context, device);
+	computeQueue = cl::CommandQueue(context, device);
+	downloadQueue = cl::CommandQueue(context, device);
+	executor.registerQueue(uploadQueue);
+	executor.registerQueue(computeQueue);
+	executor.registerQueue(downloadQueue);
+}
+
+OCLTiledLauncher::~OCLTiledLauncher()
+{
+	executor.unregisterQueue(uploadQueue);
+	executor.unregisterQueue(computeQueue);
+	executor.unregisterQueue(downloadQueue);
+}
+
+OCLTiledLauncher & OCLTiledLauncher::tile(size_t argIndex)
+{
+	if (argIndex >= kernel.Arguments.size())
+		throw OCLException("Tiled argument index out of range for kernel " + kernel.mainMethodName);
+
+	FOCLTiledArgument arg;
+	arg.argIndex = argIndex;
+	arg.var = kernel.Arguments[argIndex];
+	arg.elementSize = arg.var->getTypeSize();
+	arg.elementCount = arg.var->getSize() / arg.elementSize;
+
+	if (!tiled.empty() && arg.elementCount != elementCount)
+		throw OCLException("Tiled arguments of kernel " + kernel.mainMethodName + " differ in their element count!");
+
+	elementCount = arg.elementCount;
+	tiled.push_back(arg);
+	return *this;
+}
+
+size_t OCLTiledLauncher::getTileElements()
+{
+	if (tileElements > 0)
+		return std::min(tileElements, std::max(elementCount, (size_t)1));
+
+	FOCLDeviceInfos infos(device);
+	size_t limit = elementCount;
+	size_t bytesPerElement = 0;
+	for (FOCLTiledArgument& arg : tiled)
+	{
+		cl_ulong maxElements = infos.maxCLObjectSize / arg.elementSize;
+		if (maxElements < limit)
+			limit = (size_t)maxElements;
+		bytesPerElement += arg.elementSize;
+	}
+
+	//both slots of all tiled arguments have to fit into the remaining budget
+	std::shared_ptr<OCLMemoryManager> manager = executor.getMemoryManager();
+	FOCLMemoryStats stats = manager ? manager->getStats() : FOCLMemoryStats();
+	if (stats.budget > stats.allocated && bytesPerElement > 0)
+		limit = std::min(limit, (stats.budget - stats.allocated) / (2 * bytesPerElement));
+
+	if (kernel.localThreadCount.dimensions() > 0 && limit > kernel.localThreadCount[0])
+		limit -= limit % kernel.localThreadCount[0];
+
+	if (limit == 0 && elementCount > 0)
+		throw OCLException("Not even one element of the tiled arguments of kernel " + kernel.mainMethodName + " fits into the device memory");
+	return std::max(limit, (size_t)1);
+}
+
+size_t OCLTiledLauncher::getTileCount()
+{
+	size_t elements = getTileElements();
+	return (elementCount + elements - 1) / elements;
+}
+
+void OCLTiledLauncher::run()
+{
+	if (tiled.empty())
+		throw OCLException("No tiled argument set for kernel " + kernel.mainMethodName);
+
+	//the launcher owns the arguments until all tiles and read backs completed
+	std::vector<OCLVariable*> acquired = FOCLKernelGroup::AcquireVariables(&kernel, this);
+	try
+	{
+		runTiles();
+	}
+	catch (...)
+	{
+		uploadQueue.finish();
+		computeQueue.finish();
+		downloadQueue.finish();
+		FOCLKernelGroup::ReleaseVariables(acquired, this);
+		throw;
+	}
+	FOCLKernelGroup::ReleaseVariables(acquired, this);
+}
+
+void OCLTiledLauncher::runTiles()
+{
+	cl_int err = CL_SUCCESS;
+	std::vector<bool> isTiled(kernel.Arguments.size(), false);
+	for (FOCLTiledArgument& arg : tiled)
+		isTiled[arg.argIndex] = true;
+
+	//whole arguments are uploaded on the compute queue, so every launch comes after them
+	for (size_t i = 0; i < kernel.Arguments.size(); i++)
+	{
+		if (isTiled[i])
+			continue;
+
+		OCLVariable* var = kernel.Arguments[i];
+		cl::Memory* mem = var->getCLMemoryObject(kernel.context);
+		if (mem != NULL)
+		{
+			var->markDeviceWritten();
+			err = var->uploadBuffer(&computeQueue);
+			if (CL_SUCCESS == err)
+				err = clKernel.setArg((cl_uint)i, *mem);
+		}
+		else
+			err = clKernel.setArg((cl_uint)i, var->getSize(), var->getValue());
+
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: could not assign Argument " + var->getName() + " of tiled kernel! " + clDecodeErrorCode(err));
+	}
+
+	//the budget changes with the tile buffers, all tiles of the run use the size chosen before allocating them
+	runTileElements = getTileElements();
+	for (FOCLTiledArgument& arg : tiled)
+	{
+		for (int slot = 0; slot < 2; slot++)
+		{
+			arg.slots[slot] = cl::Buffer(*kernel.context, arg.var->getAccessType(), runTileElements * arg.elementSize, NULL, &err);
+			if (CL_SUCCESS != err)
+				throw OCLException("CL ERROR: could not create tile buffer for " + arg.var->getName() + "! " + clDecodeErrorCode(err));
+		}
+	}
+
+	for (int slot = 0; slot < 2; slot++)
+	{
+		uploaded[slot] = cl::Event();
+		computed[slot] = cl::Event();
+		downloaded[slot] = cl::Event();
+	}
+
+	size_t count = (elementCount + runTileElements - 1) / runTileElements;
+	uploadTile(0);
+	for (size_t t = 0; t < count; t++)
+	{
+		launchTile(t);
+		if (t + 1 < count)
+			uploadTile(t + 1);
+		downloadTile(t);
+	}
+
+	downloadQueue.finish();
+	err = computeQueue.finish();
+	if (CL_SUCCESS != err)
+		throw OCLException("CL ERROR: tiled kernel did not complete! " + clDecodeErrorCode(err));
+
+	for (size_t i = 0; i < kernel.Arguments.size(); i++)
+	{
+		if (!isTiled[i])
+			kernel.Arguments[i]->downloadBuffer(&computeQueue);
+	}
+	computeQueue.finish();
+
+	for (FOCLTiledArgument& arg : tiled)
+	{
+		arg.slots[0] = cl::Buffer();
+		arg.slots[1] = cl::Buffer();
+	}
+}
+
+void OCLTiledLauncher::getTileRange(size_t tile, size_t & start, size_t & count)
+{
+	start = tile * runTileElements;
+	count = std::min(runTileElements, elementCount - start);
+}
+
+void OCLTiledLauncher::uploadTile(size_t tile)
+{
+	size_t slot = tile % 2, start, count;
+	getTileRange(tile, start, count);
+
+	//the slot is free once the tile before finished its launch and download
+	std::vector<cl::Event> wait;
+	if (computed[slot]() != NULL)
+		wait.push_back(computed[slot]);
+	if (downloaded[slot]() != NULL)
+		wait.push_back(downloaded[slot]);
+
+	uploaded[slot] = cl::Event();
+	for (FOCLTiledArgument& arg : tiled)
+	{
+		if (arg.var->getAccessType() == ATWrite)
+			continue;
+
+		cl_int err = uploadQueue.enqueueWriteBuffer(arg.slots[slot], CL_FALSE, 0, count * arg.elementSize, (char*)arg.var->getValue() + start * arg.elementSize, wait.empty() ? NULL : &wait, &uploaded[slot]);
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: could not upload tile of " + arg.var->getName() + "! " + clDecodeErrorCode(err));
+		wait.clear();
+	}
+	uploadQueue.flush();
+}
+
+void OCLTiledLauncher::launchTile(size_t tile)
+{
+	size_t slot = tile % 2, start, count;
+	getTileRange(tile, start, count);
+
+	for (FOCLTiledArgument& arg : tiled)
+		clKernel.setArg((cl_uint)arg.argIndex, arg.slots[slot]);
+
+	//the tile before in this slot has to be read back before the launch overwrites it, also without an upload in between
+	std::vector<cl::Event> wait;
+	if (uploaded[slot]() != NULL)
+		wait.push_back(uploaded[slot]);
+	if (downloaded[slot]() != NULL)
+		wait.push_back(downloaded[slot]);
+
+	cl::NDRange local = cl::NullRange;
+	if (kernel.localThreadCount.dimensions() > 0 && count % kernel.localThreadCount[0] == 0)
+		local = cl::NDRange(kernel.localThreadCount[0]);
+
+	cl_int err = computeQueue.enqueueNDRangeKernel(clKernel, cl::NDRange(start), cl::NDRange(count), local, wait.empty() ? NULL : &wait, &computed[slot]);
+	if (CL_SUCCESS != err)
+		throw OCLException("CL ERROR: could not start tile of kernel " + kernel.mainMethodName + "! " + clDecodeErrorCode(err));
+	computeQueue.flush();
+}
+
+void OCLTiledLauncher::downloadTile(size_t tile)
+{
+	size_t slot = tile % 2, start, count;
+	getTileRange(tile, start, count);
+
+	std::vector<cl::Event> wait = { computed[slot] };
+	downloaded[slot] = cl::Event();
+	for (FOCLTiledArgument& arg : tiled)
+	{
+		if (arg.var->getAccessType() == ATRead)
+			continue;
+
+		cl_int err = downloadQueue.enqueueReadBuffer(arg.slots[slot], CL_FALSE, 0, count * arg.elementSize, (char*)arg.var->getValue() + start * arg.elementSize, wait.empty() ? NULL : &wait, &downloaded[slot]);
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: could not download tile of " + arg.var->getName() + "! " + clDecodeErrorCode(err));
+		wait.clear();
+	}
+	downloadQueue.flush();
+}
@@ -0,0 +1,158 @@
+#include "OCLTpxLayout.h"
+#include <chrono>
+#include <string.h>
+
+OCLTpxPixelSoABuffer::OCLTpxPixelSoABuffer(size_t length, std::string name)
+	: x(NULL, length, name + "_x"),
+	y(NULL, length, name + "_y"),
+	fToA(NULL, length, name + "_fToA"),
+	ToA(NULL, length, name + "_ToA"),
+	ToT(NULL, length, name + "_ToT")
+{
+}
+
+void OCLTpxPixelSoABuffer::resizeBuffer(size_t length)
+{
+	x.resizeBuffer(length);
+	y.resizeBuffer(length);
+	fToA.resizeBuffer(length);
+	ToA.resizeBuffer(length);
+	ToT.resizeBuffer(length);
+}
+
+void OCLTpxPixelSoABuffer::setWrittenOnDevice()
+{
+	std::vector<OCLVariable*> args = getArguments();
+	for (size_t i = 0; i < args.size(); i++)
+		args[i]->setVariableChanged(false);
+}
+
+std::vector<OCLVariable*> OCLTpxPixelSoABuffer::getArguments()
+{
+	return { &x, &y, &fToA, &ToA, &ToT };
+}
+
+bool OCLTpxPixelSoABuffer::download(cl::CommandQueue & queue)
+{
+	std::vector<OCLVariable*> args = getArguments();
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		if (args[i]->getCLMemoryObject(NULL) == NULL)
+			continue;
+
+		cl_int err = args[i]->downloadBuffer(&queue);
+		if (CL_SUCCESS != err)
+		{
+			std::printf("CL ERROR: could not read %s from CL device! [%s]\n", args[i]->getName().c_str(), clDecodeErrorCode(err).c_str());
+			return false;
+		}
+	}
+	return queue.finish() == CL_SUCCESS;
+}
+
+FTpxPixel OCLTpxPixelSoABuffer::getPixel(size_t i)
+{
+	FTpxPixel p;
+	p.x = x[i];
+	p.y = y[i];
+	p.fToA = fToA[i];
+	p.ToA = ToA[i];
+	p.ToT = ToT[i];
+	return p;
+}
+
+OCLTpxLayoutConverter::OCLTpxLayoutConverter(OpenCLExecutor& executor)
+	: executor(executor),
+	hitCountArg((cl_ulong)0, "hitCount")
+{
+	cl::Device device = executor.getDefaultDevice();
+	FOCLDeviceInfos infos(device);
+	workGroupSize = (infos.maxWorkGroupSize < 256) ? infos.maxWorkGroupSize : 256;
+
+	std::vector<std::pair<std::string, std::string>> constants = { { "WORK_GROUP_SIZE", std::to_string(workGroupSize) } };
+	transposeKernel = loadOCLKernelAndConstants(TpxLayout, "tpx_aos_to_soa", constants);
+	histogramAoSKernel = loadOCLKernelAndConstants(TpxLayout, "tot_histogram_aos", constants);
+	histogramSoAKernel = loadOCLKernelAndConstants(TpxLayout, "tot_histogram_soa", constants);
+}
+
+OCLTpxLayoutConverter::~OCLTpxLayoutConverter()
+{
+	executor.ReleaseKernel(transposeKernel);
+	executor.ReleaseKernel(histogramAoSKernel);
+	executor.ReleaseKernel(histogramSoAKernel);
+}
+
+void OCLTpxLayoutConverter::convert(OCLVariable* aosHits, OCLTpxPixelSoABuffer& out, size_t hitCount)
+{
+	if (hitCount == 0)
+		hitCount = aosHits->getSize() / sizeof(FTpxPixel);
+
+	if (out.getBufferLength() < hitCount)
+		out.resizeBuffer(hitCount);
+
+	//outputs are written by the kernel only, nothing to upload
+	out.setWrittenOnDevice();
+	hitCountArg.value[0] = hitCount;
+
+	size_t groups = (hitCount + workGroupSize - 1) / workGroupSize;
+	if (groups == 0)
+		return;
+
+	transposeKernel.Arguments = { aosHits, &hitCountArg };
+	std::vector<OCLVariable*> soa = out.getArguments();
+	transposeKernel.Arguments.insert(transposeKernel.Arguments.end(), soa.begin(), soa.end());
+	transposeKernel.globalThreadCount = cl::NDRange(groups * workGroupSize);
+	transposeKernel.localThreadCount = cl::NDRange(workGroupSize);
+
+	executor.RunKernel(transposeKernel);
+}
+
+FOCLLayoutBenchmark OCLTpxLayoutConverter::benchmarkToTHistogram(OCLVariable* aosHits, size_t hitCount, int repetitions)
+{
+	FOCLLayoutBenchmark result;
+	if (hitCount == 0)
+		hitCount = aosHits->getSize() / sizeof(FTpxPixel);
+
+	OCLTpxPixelSoABuffer soa(hitCount, "benchmark");
+	OCLDynamicTypedBuffer<cl_uint> histogram(NULL, 1024, "totHistogram");
+	memset(histogram.getValue(), 0, histogram.getSize());
+
+	FOCLDeviceInfos infos;
+	cl::Device device = executor.getDefaultDevice();
+	infos = FOCLDeviceInfos(device);
+	cl::NDRange global(infos.maxComputeUnits * 4 * workGroupSize);
+	cl::NDRange local(workGroupSize);
+
+	histogramAoSKernel.Arguments = { aosHits, &hitCountArg, &histogram };
+	histogramAoSKernel.globalThreadCount = global;
+	histogramAoSKernel.localThreadCount = local;
+	histogramSoAKernel.Arguments = { &soa.ToT, &hitCountArg, &histogram };
+	histogramSoAKernel.globalThreadCount = global;
+	histogramSoAKernel.localThreadCount = local;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	convert(aosHits, soa, hitCount);
+	auto end = std::chrono::high_resolution_clock::now();
+	result.transposeMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	//warm up, uploads the inputs and builds both programs
+	executor.RunKernel(histogramAoSKernel);
+	executor.RunKernel(histogramSoAKernel);
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < repetitions; i++)
+		executor.RunKernel(histogramAoSKernel);
+	end = std::chrono::high_resolution_clock::now();
+	result.aosMilliseconds = std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < repetitions; i++)
+		executor.RunKernel(histogramSoAKernel);
+	end = std::chrono::high_resolution_clock::now();
+	result.soaMilliseconds = std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+
+	executor.ReleaseKernel(histogramAoSKernel);
+	executor.ReleaseKernel(histogramSoAKernel);
+
+	return result;
+}
@@ -0,0 +1,89 @@
+#include "OpenCLTypes.h"
+#include <mutex>
+#include <condition_variable>
+
+namespace
+{
+	//guards owner and ownerUses of all variables
+	std::mutex ownershipLock;
+	std::condition_variable ownershipChanged;
+	//variable every blocked owner is waiting for
+	std::map<const void*, OCLVariable*> waitsFor;
+
+	typedef struct FOCLOwnershipRelease
+	{
+		OCLVariable* var;
+		const void* owner;
+	} FOCLOwnershipRelease;
+}
+
+void OCLVariable::acquireCLMemory(const void* owner)
+{
+	std::unique_lock<std::mutex> guard(ownershipLock);
+	while (this->owner != NULL && this->owner != owner)
+	{
+		//follow the owners the current owner is waiting for, reaching the caller would never resolve
+		const void* current = this->owner;
+		for (size_t i = 0; i <= waitsFor.size(); i++)
+		{
+			auto it = waitsFor.find(current);
+			if (it == waitsFor.end())
+				break;
+
+			current = it->second->owner;
+			if (current == owner)
+				throw OCLException("Deadlock detected: launches wait for each others variables");
+		}
+
+		waitsFor[owner] = this;
+		ownershipChanged.wait(guard);
+		waitsFor.erase(owner);
+	}
+
+	this->owner = owner;
+	ownerUses++;
+}
+
+void OCLVariable::releaseCLMemory(const void* owner, cl::Event* event)
+{
+	if (event != NULL && (*event)() != NULL)
+	{
+		FOCLOwnershipRelease* data = new FOCLOwnershipRelease();
+		data->var = this;
+		data->owner = owner;
+		if (event->setCallback(CL_COMPLETE, onLaunchComplete, data) == CL_SUCCESS)
+			return;
+
+		std::printf("CL WARNING: could not register launch callback, variable released before completion\n");
+		delete data;
+	}
+
+	std::lock_guard<std::mutex> guard(ownershipLock);
+	if (this->owner != owner || ownerUses == 0)
+		return;
+
+	if (--ownerUses == 0)
+	{
+		this->owner = NULL;
+		ownershipChanged.notify_all();
+	}
+}
+
+void CL_CALLBACK OCLVariable::onLaunchComplete(cl_event event, cl_int status, void * userData)
+{
+	FOCLOwnershipRelease* data = (FOCLOwnershipRelease*)userData;
+	data->var->releaseCLMemory(data->owner);
+	delete data;
+}
+
+void OCLVariable::waitForHostAccess()
+{
+	std::unique_lock<std::mutex> guard(ownershipLock);
+	ownershipChanged.wait(guard, [this]() { return owner == NULL; });
+}
+
+bool OCLVariable::isHostAccessible()
+{
+	std::lock_guard<std::mutex> guard(ownershipLock);
+	return owner == NULL;
+}
@@ -0,0 +1,276 @@
+#include "OCLWorkSizeTuner.h"
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <stdlib.h>
+
+OCLWorkSizeTuner::OCLWorkSizeTuner(std::string databasePath, OpenCLExecutor& executor)
+	: executor(executor)
+{
+	this->databasePath = databasePath;
+	device = executor.getDefaultDevice();
+	deviceInfos = FOCLDeviceInfos(device);
+	loadDatabase();
+}
+
+OCLWorkSizeTuner::~OCLWorkSizeTuner()
+{
+}
+
+FOCLTuningResult OCLWorkSizeTuner::tune(FOCLKernel& kernel, int repetitions, bool forceRetune)
+{
+	if (!executor.InitKernel(kernel))
+		throw OCLException("Could not initialize kernel for tuning: " + kernel.mainMethodName);
+
+	std::string key = makeKey(kernel);
+	if (!forceRetune)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = database.find(key);
+		if (it != database.end())
+		{
+			kernel.localThreadCount = it->second.localRange;
+			FOCLTuningResult ret = it->second;
+			ret.bFromDatabase = true;
+			return ret;
+		}
+	}
+
+	cl::CommandQueue queue(executor.getContext(), device, CL_QUEUE_PROFILING_ENABLE);
+	executor.registerQueue(queue);
+
+	//NullRange launches with the occupancy based local range of the executor, the default every candidate has to beat
+	FOCLTuningResult best;
+	try
+	{
+		best.milliseconds = timeLaunch(kernel, cl::NullRange, queue, repetitions);
+
+		for (const cl::NDRange& candidate : getCandidates(kernel))
+		{
+			double ms = timeLaunch(kernel, candidate, queue, repetitions);
+			if (ms >= 0 && (best.milliseconds < 0 || ms < best.milliseconds))
+			{
+				best.milliseconds = ms;
+				best.localRange = candidate;
+			}
+		}
+	}
+	catch (...)
+	{
+		executor.unregisterQueue(queue);
+		throw;
+	}
+	executor.unregisterQueue(queue);
+
+	if (best.milliseconds < 0)
+		throw OCLException("No local size could be launched for kernel: " + kernel.mainMethodName);
+
+	kernel.localThreadCount = best.localRange;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		database[key] = best;
+	}
+
+	if (bAutoSave)
+		saveDatabase();
+
+	return best;
+}
+
+std::vector<cl::NDRange> OCLWorkSizeTuner::getCandidates(FOCLKernel& kernel)
+{
+	std::vector<cl::NDRange> ret;
+	cl::NDRange global = kernel.globalThreadCount;
+	size_t dims = global.dimensions();
+	if (dims == 0)
+		return ret;
+
+	size_t maxSize = kernel.clKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	size_t multiple = kernel.clKernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+	if (maxSize == 0 || maxSize > deviceInfos.maxWorkGroupSize)
+		maxSize = deviceInfos.maxWorkGroupSize;
+	if (multiple == 0)
+		multiple = 1;
+
+	//the first dimension takes multiples of the preferred size, the others powers of two
+	std::vector<size_t> sizes[3];
+	for (size_t d = 0; d < dims && d < 3; d++)
+	{
+		size_t limit = std::min(maxSize, deviceInfos.maxWorkItemsPerDimension.size() > d ? deviceInfos.maxWorkItemsPerDimension[d] : maxSize);
+		for (size_t v = 1; v <= limit; v++)
+		{
+			bool isPowerOfTwo = (v & (v - 1)) == 0;
+			if (global[d] % v == 0 && (isPowerOfTwo || (d == 0 && v % multiple == 0)))
+				sizes[d].push_back(v);
+		}
+	}
+
+	if (dims == 1)
+	{
+		for (size_t x : sizes[0])
+			ret.push_back(cl::NDRange(x));
+	}
+	else
+	{
+		if (dims == 2)
+			sizes[2] = { 1 };
+
+		for (size_t x : sizes[0])
+			for (size_t y : sizes[1])
+				for (size_t z : sizes[2])
+				{
+					size_t total = x * y * z;
+					if (total > maxSize || total < multiple)
+						continue;
+
+					ret.push_back(dims == 2 ? cl::NDRange(x, y) : cl::NDRange(x, y, z));
+				}
+
+		//larger groups first, they are the more likely winners
+		std::stable_sort(ret.begin(), ret.end(), [](const cl::NDRange& a, const cl::NDRange& b)
+		{
+			size_t sa = 1, sb = 1;
+			for (size_t d = 0; d < a.dimensions(); d++)
+			{
+				sa *= a[d];
+				sb *= b[d];
+			}
+			return sa > sb;
+		});
+
+		if (ret.size() > MaxCandidates)
+			ret.resize(MaxCandidates);
+	}
+
+	return ret;
+}
+
+bool OCLWorkSizeTuner::loadDatabase()
+{
+	if (databasePath.empty())
+		return false;
+
+	std::ifstream file(databasePath);
+	if (!file.good())
+		return false;
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		//key \t local range \t milliseconds
+		size_t first = line.find('\t');
+		size_t second = line.find('\t', first + 1);
+		if (first == std::string::npos || second == std::string::npos)
+			continue;
+
+		FOCLTuningResult result;
+		result.localRange = rangeFromString(line.substr(first + 1, second - first - 1));
+		result.milliseconds = atof(line.substr(second + 1).c_str());
+		database[line.substr(0, first)] = result;
+	}
+
+	return true;
+}
+
+bool OCLWorkSizeTuner::saveDatabase()
+{
+	if (databasePath.empty())
+		return false;
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::ofstream file(databasePath, std::ofstream::trunc);
+	if (!file.good())
+	{
+		std::printf("Could not write tuning database: %s\n", databasePath.c_str());
+		return false;
+	}
+
+	for (const auto& entry : database)
+		file << entry.first << '\t' << rangeToString(entry.second.localRange) << '\t' << entry.second.milliseconds << '\n';
+
+	return true;
+}
+
+std::string OCLWorkSizeTuner::rangeToString(const cl::NDRange& range)
+{
+	if (range.dimensions() == 0)
+		return "null";
+
+	std::stringstream s;
+	for (size_t d = 0; d < range.dimensions(); d++)
+		s << (d == 0 ? "" : "x") << range[d];
+	return s.str();
+}
+
+cl::NDRange OCLWorkSizeTuner::rangeFromString(const std::string& str)
+{
+	std::vector<size_t> values;
+	std::stringstream s(str);
+	std::string part;
+	while (std::getline(s, part, 'x'))
+	{
+		if (part.empty() || part.find_first_not_of("0123456789") != std::string::npos)
+			return cl::NullRange;
+		values.push_back((size_t)std::stoull(part));
+	}
+
+	switch (values.size())
+	{
+	case 1: return cl::NDRange(values[0]);
+	case 2: return cl::NDRange(values[0], values[1]);
+	case 3: return cl::NDRange(values[0], values[1], values[2]);
+	default: return cl::NullRange;
+	}
+}
+
+std::string OCLWorkSizeTuner::makeKey(FOCLKernel& kernel)
+{
+	std::stringstream s;
+	s << deviceInfos.deviceName.c_str() << '|' << deviceInfos.driverVersion.c_str() << '|' << std::hex << kernel.sourceHash << std::dec
+		<< '|' << kernel.mainMethodName << '|' << executor.getBuildOptions(kernel) << '|' << rangeToString(kernel.globalThreadCount);
+
+	std::string ret = s.str();
+	std::replace(ret.begin(), ret.end(), '\t', ' ');
+	std::replace(ret.begin(), ret.end(), '\n', ' ');
+	return ret;
+}
+
+double OCLWorkSizeTuner::timeLaunch(FOCLKernel& kernel, const cl::NDRange& localRange, cl::CommandQueue& queue, int repetitions)
+{
+	FOCLKernel launch = kernel;
+	launch.localThreadCount = localRange;
+	FOCLKernelGroup group(launch, &queue);
+
+	double total = 0;
+	try
+	{
+		//the first launch uploads the arguments and is not timed
+		for (int i = 0; i <= repetitions; i++)
+		{
+			cl::Event event;
+			group.Run(NULL, &event);
+			if (event.wait() != CL_SUCCESS)
+			{
+				group.bIsRunning = false;
+				return -1;
+			}
+
+			if (i == 0)
+				continue;
+
+			cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+			cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			total += (double)(end - start) * 1e-6;
+		}
+	}
+	catch (OCLException&)
+	{
+		//local size not launchable for this kernel, e.g. too many resources requested
+		group.bIsRunning = false;
+		return -1;
+	}
+
+	group.bIsRunning = false;
+	return total / (repetitions > 0 ? repetitions : 1);
+}
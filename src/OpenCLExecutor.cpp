@@ -7,51 +7,43 @@
 #include <windows.h>
 #endif
 #include <sstream>
+#include <string.h>
 
 OpenCLExecutor* OpenCLExecutor::internalExec = NULL;
-#ifdef WIN32
-  MUTEXTYPE OpenCLExecutor::CL_LOCK;
-#else
-  MUTEXTYPE OpenCLExecutor::CL_LOCK;
-#endif
-
-  void OpenCLExecutor::resolveLockThreadExec()
-  {
-	  while (true)
-	  {
-#ifdef WIN32
-		Sleep(500);
-#else
-		nanosleep((const struct timespec[]) { {0, 500000000L} }, NULL);
-#endif
-		resolveLocks();
-	  }
-  }
+std::mutex OpenCLExecutor::instanceLock;
+std::atomic<unsigned long long> OpenCLExecutor::nextContextGeneration(0);
 
-  OpenCLExecutor::OpenCLExecutor()
+OpenCLExecutor::OpenCLExecutor()
 {
-	  bIsInitialized = false;
+	CREATEMUTEX(CL_LOCK);
+	bIsInitialized = false;
+	contextGeneration = 0;
 }
 
 OpenCLExecutor::~OpenCLExecutor()
 {
 	ACQUIRE_MUTEX(CL_LOCK);
-
-	/*for (int i = 0; i < workingGroups.size(); i++)
-	{
-		workingGroups[i]->CleanUpDevice();
-	}*/
-
+	releaseDevice();
 	RELEASE_MUTEX(CL_LOCK);
 	DESTROYMUTEX(CL_LOCK);
 }
 
-void OpenCLExecutor::resolveLocks()
+bool OpenCLExecutor::InitPlatform(int platformIdx, int deviceIdx)
 {
-	throw OCLException("Undefined method 'resolveLocks' called!");
+	std::vector<cl::Platform> all_platforms;
+	cl::Platform::get(&all_platforms);
+	if (all_platforms.size() == 0)
+		throw OCLException(" No platforms found. Check OpenCL installation!\n");
+	//std::printf("Found platforms: %zi\n", all_platforms.size());
+
+	std::vector<cl::Device> all_devices;
+	//Search for GPU first
+	all_platforms[platformIdx].getDevices(CL_DEVICE_TYPE_GPU, &all_devices);
+
+	return InitDevice(all_devices[deviceIdx]);
 }
 
-bool OpenCLExecutor::InitPlatform(int platformIdx, int deviceIdx)
+bool OpenCLExecutor::InitDevice(cl::Device device)
 {
 	ACQUIRE_MUTEX(CL_LOCK);
 
@@ -61,21 +53,8 @@ bool OpenCLExecutor::InitPlatform(int platformIdx, int deviceIdx)
 		return true;
 	}
 
-	std::vector<cl::Platform> all_platforms;
-	cl::Platform::get(&all_platforms);
-	if (all_platforms.size() == 0) {
-		throw OCLException(" No platforms found. Check OpenCL installation!\n");
-		RELEASE_MUTEX(CL_LOCK);
-		return false;
-	}
-	//std::printf("Found platforms: %zi\n", all_platforms.size());
-
-	std::vector<cl::Device> all_devices;
-	//Search for GPU first
-	all_platforms[platformIdx].getDevices(CL_DEVICE_TYPE_GPU, &all_devices);
-
-	device = all_devices[deviceIdx];
-	platform = all_platforms[platformIdx];
+	this->device = device;
+	platform = cl::Platform(device.getInfo<CL_DEVICE_PLATFORM>());
 
 	//Get all relevant infos
 	deviceInfos = FOCLDeviceInfos(device);
@@ -85,20 +64,42 @@ bool OpenCLExecutor::InitPlatform(int platformIdx, int deviceIdx)
 	std::printf("Using platform: %s\n", s2.str().c_str());
 	std::printf("Using device: %s | using %i cores at %i MHz \n", deviceInfos.deviceName.c_str(), device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>(), device.getInfo <CL_DEVICE_MAX_CLOCK_FREQUENCY>());
 	std::printf("OpenCL version: %s\n", deviceInfos.clVersion.c_str());
+	RELEASE_MUTEX(CL_LOCK);
+
+	//getContext takes CL_LOCK itself
+	getContext();
 
-	internalExec->getContext();
+	ACQUIRE_MUTEX(CL_LOCK);
+	memoryManager = OCLMemoryManager::getManager(context);
+	size_t budget = OCLMemoryManager::getDefaultBudget();
+	//a 32 bit host can't address more than SIZE_MAX of it anyway
+	memoryManager->setBudget(budget != 0 ? budget : (size_t)std::min<cl_ulong>(deviceInfos.maxGlobalMemory, SIZE_MAX));
+	memoryManager->setSyncCallback([this]() { finishAllQueues(); });
 
-	bIsInitialized = (internalExec->device.getInfo<CL_DEVICE_AVAILABLE>() == CL_TRUE);
+	bIsInitialized = (device.getInfo<CL_DEVICE_AVAILABLE>() == CL_TRUE);
 
 	RELEASE_MUTEX(CL_LOCK);
 	return bIsInitialized;
 }
 
+std::vector<cl::Device> OpenCLExecutor::partitionDevice(cl::Device device, unsigned int computeUnits)
+{
+	std::vector<cl::Device> ret;
+	const cl_device_partition_property properties[] = { CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)computeUnits, 0 };
+	cl_int err = device.createSubDevices(properties, &ret);
+	if (CL_SUCCESS != err)
+	{
+		std::printf("Could not partition device into sub-devices of %u compute units [%s]\n", computeUnits, clDecodeErrorCode(err).c_str());
+		ret.clear();
+	}
+	return ret;
+}
+
 std::vector<std::string> OpenCLExecutor::GetDevices(int platformIdx)
 {
 	std::vector<std::string> devices;
 
-	ACQUIRE_MUTEX(CL_LOCK);
+	std::lock_guard<std::mutex> guard(instanceLock);
 
 	std::vector<cl::Platform> all_platforms;
 	cl::Platform::get(&all_platforms);
@@ -112,7 +113,6 @@ std::vector<std::string> OpenCLExecutor::GetDevices(int platformIdx)
 		s << all_devices[i].getInfo<CL_DEVICE_NAME>();
 		devices.push_back(s.str());
 	}
-	RELEASE_MUTEX(CL_LOCK);
 
 	return devices;
 }
@@ -120,15 +120,12 @@ std::vector<std::string> OpenCLExecutor::GetDevices(int platformIdx)
 std::vector<std::string> OpenCLExecutor::GetPlatforms()
 {
 	std::vector<std::string> platforms;
-	ACQUIRE_MUTEX(CL_LOCK);
+	std::lock_guard<std::mutex> guard(instanceLock);
 
 	std::vector<cl::Platform> all_platforms;
 	cl::Platform::get(&all_platforms);
-	if (all_platforms.size() == 0) {
+	if (all_platforms.size() == 0)
 		throw OCLException(" No platforms found. Check OpenCL installation!\n");
-		RELEASE_MUTEX(CL_LOCK);
-		return platforms;
-	}
 
 	for (int i = 0; i < all_platforms.size(); i++)
 	{
@@ -136,22 +133,17 @@ std::vector<std::string> OpenCLExecutor::GetPlatforms()
 		s << all_platforms[i].getInfo<CL_PLATFORM_NAME>();
 		platforms.push_back(s.str());
 	}
-	RELEASE_MUTEX(CL_LOCK);
 
 	return platforms;
 }
 
 OpenCLExecutor & OpenCLExecutor::getExecutor()
 {
-	if(!IS_MUTEX_VALID(CL_LOCK))
-		CREATEMUTEX(CL_LOCK);
-
-	ACQUIRE_MUTEX(CL_LOCK);
+	std::lock_guard<std::mutex> guard(instanceLock);
 	if (internalExec == NULL)
 	{
 		internalExec = new OpenCLExecutor();
 	}
-	RELEASE_MUTEX(CL_LOCK);
 
 	return *internalExec;
 }
@@ -165,16 +157,54 @@ void OpenCLExecutor::DeinitPlatform()
 		return;
 	}
 
-	if (OpenCLExecutor::internalExec != NULL)
-		delete OpenCLExecutor::internalExec;
-
-	OpenCLExecutor::internalExec = NULL;
-	OpenCLExecutor::workingGroups.clear();
+	releaseDevice();
 	bIsInitialized = false;
 
 	RELEASE_MUTEX(CL_LOCK);
 }
 
+void OpenCLExecutor::releaseDevice()
+{
+	//background builds of warmUp use the context and this executor
+	{
+		std::unique_lock<std::mutex> guard(cacheLock);
+		cacheChanged.wait(guard, [this]() { return pendingBuilds.empty(); });
+		programCache.clear();
+	}
+
+	if (context != NULL)
+		finishAllQueues();
+
+	for (FOCLKernelGroup* group : workingGroups)
+		delete group;
+	workingGroups.clear();
+	{
+		std::lock_guard<std::mutex> guard(syncQueueLock);
+		syncQueues.clear();
+	}
+
+	delete batchQueue;
+	batchQueue = NULL;
+	for (size_t i = 0; i < 3; i++)
+	{
+		for (cl::CommandQueue* queue : priorityQueues[i])
+			delete queue;
+		priorityQueues[i].clear();
+		nextPriorityQueue[i] = 0;
+	}
+
+	if (memoryManager)
+	{
+		memoryManager->setSyncCallback(std::function<void()>());
+		OCLMemoryManager::releaseManager(context);
+		memoryManager.reset();
+	}
+
+	delete context;
+	context = NULL;
+	contextGeneration = 0;
+}
+
 void OpenCLExecutor::StopKernel(FOCLKernel & kernel)
 {
 	throw OCLException("Undefined method 'StopKernel' called!");
@@ -215,29 +245,38 @@ bool OpenCLExecutor::runsKernel(FOCLKernel& kernel)
 }
 
 bool OpenCLExecutor::RunKernel(FOCLKernel & kernel, bool shouldBlockVariables, const VECTOR_CLASS<cl::Event>* events, cl::Event* event)
+{
+	ValidateKernel(kernel);
+
+	return RunInitializedKernel(kernel, shouldBlockVariables, events, event);
+}
+
+void OpenCLExecutor::ValidateKernel(FOCLKernel & kernel)
 {
 	if (deviceInfos.maxWorkGroupDimensions < kernel.localThreadCount.dimensions())
-	{
 		throw OCLException("kernel dimensions too high!");
-		return false;
-	}
 
 	for (int i = 0; i < kernel.localThreadCount.dimensions(); i++)
 	{
 		if (kernel.localThreadCount[i] > deviceInfos.maxWorkItemsPerDimension[i])
-		{
 			throw OCLException("Workgroupdimension too big!");
-			return false;
-		}
 	}
 
 	if (!InitKernel(kernel))
-	{
 		throw OCLException("Could not initialize given Kernel!");
-		return false;
-	}
 
-	return RunInitializedKernel(kernel, shouldBlockVariables, events, event);
+	if (kernel.resources.bIsValid && kernel.localThreadCount.dimensions() > 0)
+	{
+		size_t total = 1;
+		for (int i = 0; i < kernel.localThreadCount.dimensions(); i++)
+			total *= kernel.localThreadCount[i];
+
+		if (total > kernel.resources.maxWorkGroupSize)
+		{
+			std::printf("%s", getResourceReport(kernel).c_str());
+			throw OCLException("Workgroup too big for the resources of kernel " + kernel.mainMethodName);
+		}
+	}
 }
 
 void OpenCLExecutor::appendKernelToQueueOf(FOCLKernel & parent, FOCLKernel & child)
@@ -251,6 +290,7 @@ void OpenCLExecutor::appendKernelToQueueOf(FOCLKernel & parent, FOCLKernel & chi
 		{
 			ReleaseKernel(child);
 			child.context = context;
+			child.contextGeneration = contextGeneration;
 		}
 		else
 			InitKernel(child);
@@ -262,76 +302,674 @@ void OpenCLExecutor::appendKernelToQueueOf(FOCLKernel & parent, FOCLKernel & chi
 
 bool OpenCLExecutor::InitKernel(FOCLKernel & kernel)
 {
+	//kernel.context may belong to a context DeinitPlatform deleted, the generation tells
+	if (kernel.context != NULL && kernel.contextGeneration == contextGeneration)
+		return true;
+
+	//both are checked again under CL_LOCK before the kernel is set up
+	unsigned long long buildGeneration = contextGeneration;
+	cl::Context* buildContext = context;
+	if (buildContext == NULL)
+	{
+		std::printf("Can't initialize %s before InitPlatform\n", kernel.mainMethodName.c_str());
+		return false;
+	}
+
+	//source may have been assigned after construction, a precomputed hash of OCL_RC is the same for the unchanged source
+	kernel.sourceHash = oclHashSource(kernel.source);
+	std::string options = getBuildOptions(kernel);
+	FOCLProgramKey key(kernel.sourceHash, options);
+
+	//waiting for and building programs happens without CL_LOCK, launches of other kernels continue meanwhile
+	cl::Program program;
+	if (!getCachedProgram(key, program, true))
+	{
+		FOCLKernel build = kernel;
+		build.context = buildContext;
+		build.device = &device;
+		bool success = false;
+		try
+		{
+			success = buildProgram(build, options);
+		}
+		catch (...)
+		{
+			std::printf("Unknown error building %s\n", kernel.mainMethodName.c_str());
+		}
+
+		finishBuild(key, build.program, success);
+		if (!success)
+			return false;
+		program = build.program;
+	}
+
 	ACQUIRE_MUTEX(CL_LOCK);
-	if (kernel.context != NULL)
+	//DeinitPlatform released the context the program was built for
+	if (contextGeneration != buildGeneration)
+	{
+		RELEASE_MUTEX(CL_LOCK);
+		return false;
+	}
+
+	if (kernel.context != NULL && kernel.contextGeneration == buildGeneration)
 	{
 		RELEASE_MUTEX(CL_LOCK);
 		return true;
 	}
 
 	kernel.context = context;
+	kernel.contextGeneration = buildGeneration;
 	kernel.device = &device;
+	kernel.program = program;
+	kernel.clKernel = cl::Kernel(kernel.program, kernel.mainMethodName.c_str());
+	collectResources(kernel);
+	kernel.kernelID = (size_t)(kernel.sourceHash ^ std::hash<std::string>{}(kernel.mainMethodName + " " + options));
+	for(int i = 0; i < kernel.Arguments.size(); i++)
+		kernel.kernelID += std::hash<int>{}(*(int*)kernel.Arguments[i]);
+
+	RELEASE_MUTEX(CL_LOCK);
+
+	return true;
+}
+
+void OpenCLExecutor::collectResources(FOCLKernel & kernel)
+{
+	FOCLKernelResourceInfo& info = kernel.resources;
+	info = FOCLKernelResourceInfo();
+	try
+	{
+		info.maxWorkGroupSize = kernel.clKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		info.preferredMultiple = kernel.clKernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+		info.localMemSize = kernel.clKernel.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device);
+		info.privateMemSize = kernel.clKernel.getWorkGroupInfo<CL_KERNEL_PRIVATE_MEM_SIZE>(device);
+		cl::size_t<3> compileSize = kernel.clKernel.getWorkGroupInfo<CL_KERNEL_COMPILE_WORK_GROUP_SIZE>(device);
+		for (int i = 0; i < 3; i++)
+			info.compileWorkGroupSize[i] = compileSize[i];
+	}
+	catch (...)
+	{
+		std::printf("Could not query work group info of kernel %s\n", kernel.mainMethodName.c_str());
+		return;
+	}
+
+	if (info.maxWorkGroupSize == 0 || info.maxWorkGroupSize > deviceInfos.maxWorkGroupSize)
+		info.maxWorkGroupSize = deviceInfos.maxWorkGroupSize;
+	if (info.preferredMultiple == 0)
+		info.preferredMultiple = 1;
+
+	info.deviceLocalMemSize = deviceInfos.maxDeviceMemory;
+	info.computeUnits = (cl_uint)std::max(deviceInfos.maxComputeUnits, 1);
+	for (size_t i = 0; i < 3 && i < deviceInfos.maxWorkItemsPerDimension.size(); i++)
+		info.maxWorkItems[i] = deviceInfos.maxWorkItemsPerDimension[i];
+	info.bIsValid = true;
+}
+
+FOCLKernelResourceInfo OpenCLExecutor::getKernelResources(FOCLKernel & kernel)
+{
+	if (!InitKernel(kernel))
+		throw OCLException("Could not initialize kernel " + kernel.mainMethodName);
+	return kernel.resources;
+}
+
+std::string OpenCLExecutor::getResourceReport(FOCLKernel & kernel)
+{
+	FOCLKernelResourceInfo info = getKernelResources(kernel);
+	std::stringstream s;
+	s << "Resources of kernel " << kernel.mainMethodName << " on " << deviceInfos.deviceName << ":\n";
+	if (!info.bIsValid)
+	{
+		s << "\tnot available\n";
+		return s.str();
+	}
+
+	s << "\twork group size limit: " << info.maxWorkGroupSize << " (device " << deviceInfos.maxWorkGroupSize << ")\n";
+	s << "\tpreferred size multiple: " << info.preferredMultiple << "\n";
+	s << "\tlocal memory per group: " << info.localMemSize << " of " << info.deviceLocalMemSize << " bytes\n";
+	s << "\tprivate memory per item: " << info.privateMemSize << " bytes\n";
+	if (info.compileWorkGroupSize[0] != 0)
+		s << "\trequired work group size: " << info.compileWorkGroupSize[0] << "x" << info.compileWorkGroupSize[1] << "x" << info.compileWorkGroupSize[2] << "\n";
+	if (info.localMemSize > 0)
+		s << "\tgroups per compute unit by local memory: " << info.getGroupsPerComputeUnit() << "\n";
+
+	if (kernel.globalThreadCount.dimensions() > 0)
+	{
+		cl::NDRange local = info.getOccupancyLocalRange(kernel.globalThreadCount, kernel.rangePadding != RPNone);
+		s << "\tchosen local size for the current global size: ";
+		if (local.dimensions() == 0)
+			s << "driver default";
+		for (size_t d = 0; d < local.dimensions(); d++)
+			s << (d == 0 ? "" : "x") << local[d];
+		s << "\n";
+	}
+
+	return s.str();
+}
+
+bool OpenCLExecutor::buildProgram(FOCLKernel & kernel, const std::string & options)
+{
+	if (buildFromEmbeddedBinary(kernel, options))
+		return true;
 
 	cl::Program::Sources sources({{ kernel.source.c_str(),kernel.source.length() }});
+	kernel.program = cl::Program(*kernel.context, sources);
+	if (kernel.program.build({ *kernel.device }, options.c_str()) == CL_SUCCESS)
+		return true;
+
+	std::stringstream s;
+	s << kernel.program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(*kernel.device);
+	std::printf("Error building %s: %s\n", kernel.mainMethodName.c_str(), s.str().c_str());
+	return false;
+}
+
+bool OpenCLExecutor::getCachedProgram(const FOCLProgramKey & key, cl::Program & program, bool claim)
+{
+	std::unique_lock<std::mutex> guard(cacheLock);
+	cacheChanged.wait(guard, [&]() { return pendingBuilds.count(key) == 0; });
 
-	try {
-		kernel.program = cl::Program(*kernel.context, sources);
-		if (kernel.program.build({ *kernel.device }) != CL_SUCCESS) {
-			try {
-				std::stringstream s;
-				s << kernel.program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(*kernel.device);
-				std::printf("Error building: %s\n", s.str().c_str());
-				throw OCLException(" Error building:" + s.str());
+	auto it = programCache.find(key);
+	if (it == programCache.end())
+	{
+		if (claim)
+			pendingBuilds.insert(key);
+		return false;
+	}
+
+	program = it->second;
+	return true;
+}
+
+void OpenCLExecutor::finishBuild(const FOCLProgramKey & key, const cl::Program & program, bool success)
+{
+	{
+		std::lock_guard<std::mutex> guard(cacheLock);
+		pendingBuilds.erase(key);
+		if (success)
+			programCache[key] = program;
+		//inside the lock, a waiting releaseDevice may destroy the executor right after
+		cacheChanged.notify_all();
+	}
+}
+
+OCLBuildHandle OpenCLExecutor::warmUp(std::vector<FOCLKernel> kernels)
+{
+	if (!bIsInitialized || context == NULL)
+		throw OCLException("warmUp needs an initialized executor, call InitPlatform first");
+
+	OCLBuildHandle handle;
+	//the options are resolved now, later changes of the global options do not affect these builds
+	std::vector<std::pair<FOCLKernel, std::string>> builds;
+	for (FOCLKernel& kernel : kernels)
+	{
+		kernel.sourceHash = oclHashSource(kernel.source);
+		builds.push_back({ kernel, getBuildOptions(kernel) });
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(cacheLock);
+		for (size_t i = builds.size(); i > 0; i--)
+		{
+			FOCLProgramKey key(builds[i - 1].first.sourceHash, builds[i - 1].second);
+			if (programCache.count(key) > 0 || !pendingBuilds.insert(key).second)
+				builds.erase(builds.begin() + (i - 1));
+		}
+	}
+
+	handle.addPending(builds.size());
+	for (auto& build : builds)
+	{
+		//the builds do not touch CL_LOCK, kernels can be run while others are still compiling
+		//InitKernel of a task on getThreadPool may wait for this build, so it must not queue behind that task
+		OCLThreadPool::getBuildPool().enqueue([this, kernel = build.first, options = build.second, handle]() mutable
+		{
+			kernel.context = context;
+			kernel.device = &device;
+
+			bool success = false;
+			try
+			{
+				success = buildProgram(kernel, options);
 			}
 			catch (...)
 			{
-				std::printf("Unknown critical error found!\n");
-				throw OCLException(" Error building!");
+				std::printf("Unknown error building %s in background\n", kernel.mainMethodName.c_str());
 			}
-			RELEASE_MUTEX(CL_LOCK);
+
+			finishBuild(FOCLProgramKey(kernel.sourceHash, options), kernel.program, success);
+			handle.finish(success);
+		});
+	}
+
+	return handle;
+}
+
+bool OpenCLExecutor::buildFromEmbeddedBinary(FOCLKernel & kernel, const std::string& options)
+{
+	const FOCLEmbeddedBinarySet& set = kernel.binaries;
+	if (set.count == 0 || set.sourceHash != kernel.sourceHash || options != set.buildOptions)
+		return false;
+
+	//binaries are bound to the exact device and driver they were compiled with
+	for (size_t i = 0; i < set.count; i++)
+	{
+		const FOCLEmbeddedBinary& bin = set.binaries[i];
+		if (strcmp(bin.deviceName, deviceInfos.deviceName.c_str()) != 0 || strcmp(bin.driverVersion, deviceInfos.driverVersion.c_str()) != 0)
+			continue;
+
+		cl_int err = CL_SUCCESS;
+		std::vector<cl_int> binaryStatus;
+		cl::Program::Binaries binaries(1, std::make_pair((const void*)bin.data, bin.size));
+		cl::Program program(*kernel.context, { *kernel.device }, binaries, &binaryStatus, &err);
+		if (err != CL_SUCCESS || program.build({ *kernel.device }, set.buildOptions) != CL_SUCCESS)
+		{
+			std::printf("Embedded binary of %s rejected, building from source\n", kernel.mainMethodName.c_str());
 			return false;
 		}
+
+		kernel.program = program;
+		return true;
 	}
-	catch (...)
+
+	return false;
+}
+
+void OpenCLExecutor::setGlobalBuildOptions(std::string options)
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+	globalBuildOptions = options;
+}
+
+std::string OpenCLExecutor::getGlobalBuildOptions()
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+	return globalBuildOptions;
+}
+
+void OpenCLExecutor::setDefaultBuildProfile(EOCLBuildProfile profile)
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+	defaultBuildProfile = (profile == BPDefault) ? BPStandard : profile;
+}
+
+EOCLBuildProfile OpenCLExecutor::getDefaultBuildProfile()
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+	return defaultBuildProfile;
+}
+
+std::string OpenCLExecutor::getProfileBuildOptions(EOCLBuildProfile profile)
+{
+	if (profile == BPDefault)
+		profile = getDefaultBuildProfile();
+
+	switch (profile)
+	{
+	case BPPrecise:
 	{
-		std::printf("Unknown uncritical error found\n");
+		cl_device_fp_config config = device.getInfo<CL_DEVICE_SINGLE_FP_CONFIG>();
+		return (config & CL_FP_CORRECTLY_ROUNDED_DIVIDE_SQRT) ? "-cl-fp32-correctly-rounded-divide-sqrt" : "";
 	}
-	kernel.clKernel = cl::Kernel(kernel.program, kernel.mainMethodName.c_str());
-	kernel.kernelID = std::hash<std::string>{}(kernel.source + kernel.mainMethodName);
-	for(int i = 0; i < kernel.Arguments.size(); i++)
-		kernel.kernelID += std::hash<int>{}(*(int*)kernel.Arguments[i]);
+	case BPFast:
+		return "-cl-fast-relaxed-math -cl-mad-enable";
+	default:
+		return "";
+	}
+}
 
-	RELEASE_MUTEX(CL_LOCK);
+std::string OpenCLExecutor::getBuildOptions(const FOCLKernel & kernel)
+{
+	std::string ret;
+	for (const std::string& part : { getProfileBuildOptions(kernel.buildProfile), getGlobalBuildOptions(), kernel.getBuildOptions() })
+	{
+		if (part.empty())
+			continue;
+		ret += (ret.empty() ? "" : " ") + part;
+	}
+	return ret;
+}
 
-	return true;
+size_t OpenCLExecutor::getProgramCacheSize()
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+	return programCache.size();
+}
+
+void OpenCLExecutor::clearProgramCache()
+{
+	std::lock_guard<std::mutex> guard(cacheLock);
+	programCache.clear();
 }
 
 bool OpenCLExecutor::RunInitializedKernel(FOCLKernel & kernel, bool shouldBlockVariables, const VECTOR_CLASS<cl::Event>* events, cl::Event* event)
 {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
 	ACQUIRE_MUTEX(CL_LOCK);
 	FOCLKernelGroup* g = getWorkingGroupOfKernel(kernel);
+	if (NULL == g)
+	{
+		try
+		{
+			if (kernel.priority == QPNormal)
+			{
+				workingGroups.push_back(new FOCLKernelGroup(kernel, shouldBlockVariables));
+				registerQueue(*workingGroups.back()->queue);
+			}
+			else
+				workingGroups.push_back(new FOCLKernelGroup(kernel, getPriorityQueue(kernel.priority), shouldBlockVariables));
+		}
+		catch (...)
+		{
+			RELEASE_MUTEX(CL_LOCK);
+			throw;
+		}
+		g = workingGroups.back();
+	}
+	RELEASE_MUTEX(CL_LOCK);
+
+	//the group owns the variables, waiting for launches of other groups neither blocks CL_LOCK nor the gate
+	std::vector<OCLVariable*> acquired;
+	if (g->bShouldBlockVariables)
+		acquired = FOCLKernelGroup::AcquireVariables(&kernel, g);
+
+	acquireLaunch(kernel.priority);
+	std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
 
-	if (NULL != g)
+	//the gate and CL_LOCK only cover the submission, the completion is awaited on the launch event afterwards
+	cl::Event launchEvent;
+	if (event == NULL)
+		event = &launchEvent;
+
+	ACQUIRE_MUTEX(CL_LOCK);
+	if (getWorkingGroupOfKernel(kernel) != g)
 	{
-		g->WaitForGroup(&kernel);
+		RELEASE_MUTEX(CL_LOCK);
+		releaseLaunch();
+		for (OCLVariable* var : acquired)
+			var->releaseCLMemory(g);
+		throw OCLException("Kernel " + kernel.mainMethodName + " was released while its launch waited for its variables");
+	}
 
-		//exec
-		g->Run(events, event, &kernel);
+	try
+	{
+		//exec, the in order queue starts it after the previous launch of the group
+		g->Run(events, event, &kernel, true, &acquired);
+	}
+	catch (...)
+	{
+		RELEASE_MUTEX(CL_LOCK);
+		releaseLaunch();
+		throw;
+	}
+	RELEASE_MUTEX(CL_LOCK);
+	releaseLaunch();
 
-		g->WaitForGroup(&kernel);
+	//an empty range enqueues nothing and has no event
+	if ((*event)() != NULL)
+	{
+		cl_int err = event->wait();
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: kernel " + kernel.mainMethodName + " did not complete! " + clDecodeErrorCode(err));
 	}
-	else
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> guard(priorityLock);
+		FOCLLatencyStats& stats = latencyStats[kernel.priority];
+		stats.count++;
+		stats.totalWaitMs += std::chrono::duration<double, std::milli>(submitted - start).count();
+		stats.lastLatencyMs = std::chrono::duration<double, std::milli>(end - start).count();
+		stats.totalLatencyMs += stats.lastLatencyMs;
+		if (stats.lastLatencyMs > stats.maxLatencyMs)
+			stats.maxLatencyMs = stats.lastLatencyMs;
+	}
+
+	return true;
+}
+
+void OpenCLExecutor::acquireLaunch(EOCLQueuePriority priority)
+{
+	std::unique_lock<std::mutex> guard(priorityLock);
+	waitingLaunches[priority]++;
+	priorityChanged.wait(guard, [this, priority]()
+	{
+		if (bLaunchActive)
+			return false;
+		for (int p = 0; p < priority; p++)
+			if (waitingLaunches[p] > 0)
+				return false;
+		return true;
+	});
+	waitingLaunches[priority]--;
+	bLaunchActive = true;
+}
+
+void OpenCLExecutor::releaseLaunch()
+{
+	{
+		std::lock_guard<std::mutex> guard(priorityLock);
+		bLaunchActive = false;
+	}
+	priorityChanged.notify_all();
+}
+
+cl::CommandQueue * OpenCLExecutor::getPriorityQueue(EOCLQueuePriority priority)
+{
+	std::vector<cl::CommandQueue*>& set = priorityQueues[priority];
+	if (set.empty())
+	{
+		cl_bitfield hint = (priority == QPHigh) ? CL_QUEUE_PRIORITY_HIGH_KHR : (priority == QPLow) ? CL_QUEUE_PRIORITY_LOW_KHR : CL_QUEUE_PRIORITY_MED_KHR;
+		typedef cl_command_queue(CL_API_CALL *FCreateQueueWithProperties)(cl_context, cl_device_id, const cl_bitfield*, cl_int*);
+		FCreateQueueWithProperties createQueue = NULL;
+		if (supportsPriorityHints())
+			createQueue = (FCreateQueueWithProperties)clGetExtensionFunctionAddressForPlatform(platform(), "clCreateCommandQueueWithPropertiesKHR");
+
+		for (size_t i = 0; i < QueuesPerPriority; i++)
+		{
+			cl_int err = CL_SUCCESS;
+			if (createQueue != NULL)
+			{
+				const cl_bitfield properties[] = { CL_QUEUE_PRIORITY_KHR, hint, 0 };
+				cl_command_queue queue = createQueue((*context)(), device(), properties, &err);
+				if (CL_SUCCESS == err)
+				{
+					set.push_back(new cl::CommandQueue(queue));
+					registerQueue(*set.back());
+					continue;
+				}
+				std::printf("Could not create queue with priority hint, using a default queue [%s]\n", clDecodeErrorCode(err).c_str());
+			}
+			set.push_back(new cl::CommandQueue(*context, device));
+			registerQueue(*set.back());
+		}
+	}
+
+	return set[nextPriorityQueue[priority]++ % set.size()];
+}
+
+void OpenCLExecutor::finishAllQueues()
+{
+	//the copies keep the queues alive if their owner deletes them meanwhile
+	std::vector<cl::CommandQueue> queues;
+	{
+		std::lock_guard<std::mutex> guard(syncQueueLock);
+		queues = syncQueues;
+	}
+
+	for (cl::CommandQueue& queue : queues)
+		queue.finish();
+}
+
+void OpenCLExecutor::registerQueue(const cl::CommandQueue & queue)
+{
+	std::lock_guard<std::mutex> guard(syncQueueLock);
+	syncQueues.push_back(queue);
+}
+
+void OpenCLExecutor::unregisterQueue(const cl::CommandQueue & queue)
+{
+	std::lock_guard<std::mutex> guard(syncQueueLock);
+	for (auto it = syncQueues.begin(); it != syncQueues.end(); it++)
+	{
+		if ((*it)() == queue())
+		{
+			syncQueues.erase(it);
+			return;
+		}
+	}
+}
+
+bool OpenCLExecutor::supportsPriorityHints()
+{
+	std::string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+	return extensions.find("cl_khr_priority_hints") != std::string::npos && extensions.find("cl_khr_create_command_queue") != std::string::npos;
+}
+
+FOCLLatencyStats OpenCLExecutor::getLatencyStats(EOCLQueuePriority priority)
+{
+	std::lock_guard<std::mutex> guard(priorityLock);
+	return latencyStats[priority];
+}
+
+void OpenCLExecutor::resetLatencyStats()
+{
+	std::lock_guard<std::mutex> guard(priorityLock);
+	for (FOCLLatencyStats& stats : latencyStats)
+		stats = FOCLLatencyStats();
+}
+
+cl::Event OpenCLExecutor::RunBatch(std::vector<FOCLKernel*> kernels, std::vector<OCLVariable*> downloads, const VECTOR_CLASS<cl::Event>* events, bool waitForCompletion)
+{
+	for (FOCLKernel* kernel : kernels)
 	{
-		workingGroups.push_back(new FOCLKernelGroup(kernel, shouldBlockVariables));
-		size_t pos = workingGroups.size() - 1;
-		//exec
-		workingGroups[pos]->Run(events, event, &kernel);
+		if (!InitKernel(*kernel))
+			throw OCLException("Could not initialize batched kernel " + kernel->mainMethodName);
+	}
+
+	getContext();
 
-		workingGroups[pos]->WaitForGroup(&kernel);
+	//all batches share one in order queue and one owner, launches of other groups wait until the batch completed
+	const void* owner = &batchQueue;
+	std::vector<OCLVariable*> acquired;
+	try
+	{
+		for (FOCLKernel* kernel : kernels)
+		{
+			std::vector<OCLVariable*> vars = FOCLKernelGroup::AcquireVariables(kernel, owner);
+			acquired.insert(acquired.end(), vars.begin(), vars.end());
+		}
+		for (OCLVariable* var : downloads)
+		{
+			var->acquireCLMemory(owner);
+			acquired.push_back(var);
+		}
+	}
+	catch (...)
+	{
+		FOCLKernelGroup::ReleaseVariables(acquired, owner);
+		throw;
+	}
+
+	cl::Event ret;
+	ACQUIRE_MUTEX(CL_LOCK);
+	try
+	{
+		if (batchQueue == NULL)
+		{
+			batchQueue = new cl::CommandQueue(*context, device);
+			registerQueue(*batchQueue);
+		}
+
+		if (events != NULL && !events->empty() && CL_SUCCESS != batchQueue->enqueueBarrierWithWaitList(events))
+			throw OCLException("CL ERROR: could not wait for the events of the batch!");
+
+		//the launch captures the kernel arguments, so the temporary groups can go right after recording
+		for (FOCLKernel* kernel : kernels)
+		{
+			FOCLKernelGroup group(*kernel, batchQueue);
+			try
+			{
+				group.Run(NULL, NULL, NULL, false);
+			}
+			catch (...)
+			{
+				group.bIsRunning = false;
+				throw;
+			}
+			group.bIsRunning = false;
+		}
+
+		for (OCLVariable* var : downloads)
+		{
+			//the marker orders the reads, nothing waits for the device under the lock
+			cl_int errcode = var->downloadBuffer(batchQueue, false);
+			if (CL_SUCCESS != errcode)
+				std::printf("CL ERROR: could not read buffer with name: %s from CL device! [%s]\n", var->getName().c_str(), clDecodeErrorCode(errcode).c_str());
+		}
+
+		cl_int err = batchQueue->enqueueMarkerWithWaitList(NULL, &ret);
+		if (CL_SUCCESS == err)
+			err = batchQueue->flush();
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: could not submit batch! " + clDecodeErrorCode(err));
+	}
+	catch (...)
+	{
+		//launches enqueued before the failure may still use the variables
+		if (batchQueue != NULL)
+			batchQueue->finish();
+		RELEASE_MUTEX(CL_LOCK);
+		FOCLKernelGroup::ReleaseVariables(acquired, owner);
+		throw;
 	}
 	RELEASE_MUTEX(CL_LOCK);
+	FOCLKernelGroup::ReleaseVariables(acquired, owner, &ret);
 
-	return true;
+	if (waitForCompletion)
+	{
+		cl_int err = ret.wait();
+		if (CL_SUCCESS != err)
+			throw OCLException("CL ERROR: batch did not complete! " + clDecodeErrorCode(err));
+	}
+
+	return ret;
+}
+
+void OpenCLExecutor::RunKernelAsync(FOCLKernel & kernel, std::function<void(bool, std::vector<OCLVariable*>)> onComplete, std::vector<OCLVariable*> downloads)
+{
+	ValidateKernel(kernel);
+
+	if (downloads.empty())
+	{
+		for (OCLVariable* var : kernel.Arguments)
+			if (var->getAccessType() != ATRead)
+				downloads.push_back(var);
+	}
+
+	std::vector<FOCLKernel*> kernels = { &kernel };
+	cl::Event event = RunBatch(kernels, downloads, NULL, false);
+	setCompletionCallback(event, [onComplete, downloads](bool success) { onComplete(success, downloads); });
+}
+
+void OpenCLExecutor::setCompletionCallback(cl::Event & event, std::function<void(bool)> callback)
+{
+	std::function<void(bool)>* data = new std::function<void(bool)>(callback);
+	if (CL_SUCCESS == event.setCallback(CL_COMPLETE, &OpenCLExecutor::onEventComplete, data))
+		return;
+
+	//no callback support, a pool thread waits instead
+	delete data;
+	OCLThreadPool::getThreadPool().enqueue([event, callback]() mutable { callback(event.wait() == CL_SUCCESS); });
+}
+
+void CL_CALLBACK OpenCLExecutor::onEventComplete(cl_event event, cl_int status, void * userData)
+{
+	//the driver thread must not block, the callback runs on the pool
+	std::function<void(bool)>* callback = (std::function<void(bool)>*)userData;
+	OCLThreadPool::getThreadPool().enqueue([callback, status]()
+	{
+		std::unique_ptr<std::function<void(bool)>> owner(callback);
+		(*owner)(status == CL_COMPLETE);
+	});
 }
 
 void OpenCLExecutor::createWorkgroup(FOCLKernel & kernel)
@@ -339,7 +977,10 @@ void OpenCLExecutor::createWorkgroup(FOCLKernel & kernel)
 	InitKernel(kernel);
 	FOCLKernelGroup* g = getWorkingGroupOfKernel(kernel);
 	if (g == NULL)
+	{
 		workingGroups.push_back(new FOCLKernelGroup(kernel));
+		registerQueue(*workingGroups.back()->queue);
+	}
 }
 
 std::vector<OCLVariable*> OpenCLExecutor::GetAllResultsOf(FOCLKernel & kernel, bool waitForKernelToFinish)
@@ -384,6 +1025,8 @@ void OpenCLExecutor::ReleaseKernel(FOCLKernel & kernel)
 		{
 			//workingGroups[i]->CleanUpDevice();
 			workingGroups[i]->bIsRunning = false;
+			if (!workingGroups[i]->bIsChild)
+				unregisterQueue(*workingGroups[i]->queue);
 			kernel.context = NULL;
 			delete workingGroups[i];
 			workingGroups.erase(workingGroups.begin() + i);
@@ -502,6 +1145,7 @@ cl::Context OpenCLExecutor::getContext()
 	if (!context)
 	{
 		context = new cl::Context(device);
+		contextGeneration = ++nextContextGeneration;
 	}
 	RELEASE_MUTEX(CL_LOCK);
 
@@ -2,13 +2,7 @@ void kernel simple_add(global const int* A, global const int* B, global int* C){
        C[get_global_id(0)]=A[get_global_id(0)]+B[get_global_id(0)];
 }
 
-typedef struct __attribute__((packed)) FTpxPixel
-{
-	struct __attribute__((packed)) Coord { uchar x, y; } coord;
-	uchar fToA;
-	ulong ToA;
-	ushort ToT;
-} FTpxPixel;
+#include "TpxPixel.clh"
 
 
 void kernel image_test(__global FTpxPixel* buffer, ulong lowAddress, ulong highAddress, __write_only image2d_t outImage)
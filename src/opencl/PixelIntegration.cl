@@ -0,0 +1,60 @@
+#include "TpxPixel.clh"
+
+/* TILE_SIZE and optionally SENSOR_WIDTH/SENSOR_HEIGHT are set as build options by OCLPixelIntegrator */
+#ifndef TILE_SIZE
+#define TILE_SIZE 64
+#endif
+
+/* Integrates all hits with ToA in [addFrom, addTo) and subtracts all hits with ToA in [subFrom, subTo).
+   dim 0 strides over the hits, dim 1 selects the image tile accumulated in local memory by the work group.
+   A sliding window only passes the newly covered and the expired time ranges. */
+void kernel integrate_hits(__global const FTpxPixel* hits, ulong hitCount, ulong addFrom, ulong addTo, ulong subFrom, ulong subTo, int useToT, int width, int height, __global int* image)
+{
+	__local int tileHist[TILE_SIZE * TILE_SIZE];
+
+#ifdef SENSOR_WIDTH
+	/* the geometry is folded into the program, the arguments are ignored */
+	width = SENSOR_WIDTH;
+	height = SENSOR_HEIGHT;
+#endif
+
+	int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	int tileX = (get_global_id(1) % tilesX) * TILE_SIZE;
+	int tileY = (get_global_id(1) / tilesX) * TILE_SIZE;
+
+	for (int i = get_local_id(0); i < TILE_SIZE * TILE_SIZE; i += get_local_size(0))
+		tileHist[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (ulong i = get_global_id(0); i < hitCount; i += get_global_size(0))
+	{
+		ulong toa = hits[i].ToA;
+		int sign = 0;
+		if (toa >= addFrom && toa < addTo)
+			sign = 1;
+		else if (toa >= subFrom && toa < subTo)
+			sign = -1;
+
+		if (sign == 0)
+			continue;
+
+		int x = (int)hits[i].coord.x - tileX;
+		int y = (int)hits[i].coord.y - tileY;
+		if (x < 0 || y < 0 || x >= TILE_SIZE || y >= TILE_SIZE)
+			continue;
+
+		int weight = useToT ? (int)hits[i].ToT : 1;
+		atomic_add(&tileHist[y * TILE_SIZE + x], sign * weight);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = get_local_id(0); i < TILE_SIZE * TILE_SIZE; i += get_local_size(0))
+	{
+		int x = tileX + i % TILE_SIZE;
+		int y = tileY + i / TILE_SIZE;
+		if (tileHist[i] != 0 && x < width && y < height)
+			atomic_add(&image[y * width + x], tileHist[i]);
+	}
+}
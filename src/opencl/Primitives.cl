@@ -0,0 +1,200 @@
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#define T %T%
+#define T_MAX %T_MAX%
+#define T_LOWEST %T_LOWEST%
+#define T_IS_FLOAT %T_IS_FLOAT%
+#define OP_ID %OP%
+#define WORK_GROUP_SIZE %WORK_GROUP_SIZE%
+#define ITEMS 4
+#define LOCAL_BINS %LOCAL_BINS%
+#define PREDICATE(x) (%PREDICATE%)
+
+#if OP_ID == 1
+#define REDUCE_OP(a, b) min(a, b)
+#define IDENTITY T_MAX
+#elif OP_ID == 2
+#define REDUCE_OP(a, b) max(a, b)
+#define IDENTITY T_LOWEST
+#else
+#define REDUCE_OP(a, b) ((a) + (b))
+#define IDENTITY ((T)0)
+#endif
+
+/* inclusive scan over the work group, all work items have to call it */
+T scan_local(__local T* tmp, T value)
+{
+	uint lid = get_local_id(0);
+	tmp[lid] = value;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint offset = 1; offset < WORK_GROUP_SIZE; offset <<= 1)
+	{
+		T t = (lid >= offset) ? tmp[lid - offset] : (T)0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		tmp[lid] += t;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	T result = tmp[lid];
+	barrier(CLK_LOCAL_MEM_FENCE);
+	return result;
+}
+
+/* every group reduces a grid strided part of the input into partials[group] */
+void kernel reduce_blocks(__global const T* in, ulong count, __global T* partials)
+{
+	__local T tmp[WORK_GROUP_SIZE];
+	uint lid = get_local_id(0);
+
+	T acc = IDENTITY;
+	for (ulong i = get_global_id(0); i < count; i += get_global_size(0))
+		acc = REDUCE_OP(acc, in[i]);
+
+	tmp[lid] = acc;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint s = WORK_GROUP_SIZE / 2; s > 0; s >>= 1)
+	{
+		if (lid < s)
+			tmp[lid] = REDUCE_OP(tmp[lid], tmp[lid + s]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (lid == 0)
+		partials[get_group_id(0)] = tmp[0];
+}
+
+/* scans blocks of WORK_GROUP_SIZE * ITEMS elements, the block is staged in local memory to keep global accesses coalesced */
+void kernel scan_blocks(__global const T* in, __global T* out, ulong count, int inclusive, __global T* blockSums)
+{
+	__local T block[WORK_GROUP_SIZE * ITEMS];
+	__local T tmp[WORK_GROUP_SIZE];
+	uint lid = get_local_id(0);
+	ulong base = get_group_id(0) * WORK_GROUP_SIZE * ITEMS;
+
+	for (uint k = 0; k < ITEMS; k++)
+	{
+		ulong i = base + k * WORK_GROUP_SIZE + lid;
+		block[k * WORK_GROUP_SIZE + lid] = (i < count) ? in[i] : (T)0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	T v[ITEMS];
+	T sum = 0;
+	for (uint k = 0; k < ITEMS; k++)
+	{
+		v[k] = block[lid * ITEMS + k];
+		sum += v[k];
+	}
+
+	T offset = scan_local(tmp, sum) - sum;
+	if (lid == WORK_GROUP_SIZE - 1)
+		blockSums[get_group_id(0)] = offset + sum;
+
+	for (uint k = 0; k < ITEMS; k++)
+	{
+		if (inclusive)
+			offset += v[k];
+		block[lid * ITEMS + k] = offset;
+		if (!inclusive)
+			offset += v[k];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint k = 0; k < ITEMS; k++)
+	{
+		ulong i = base + k * WORK_GROUP_SIZE + lid;
+		if (i < count)
+			out[i] = block[k * WORK_GROUP_SIZE + lid];
+	}
+}
+
+/* adds the scanned block sums onto the blocks of scan_blocks */
+void kernel scan_add_offsets(__global T* out, ulong count, __global const T* scannedBlockSums)
+{
+	T offset = scannedBlockSums[get_group_id(0)];
+	ulong base = get_group_id(0) * WORK_GROUP_SIZE * ITEMS;
+
+	for (uint k = 0; k < ITEMS; k++)
+	{
+		ulong i = base + k * WORK_GROUP_SIZE + get_local_id(0);
+		if (i < count)
+			out[i] += offset;
+	}
+}
+
+/* values outside [minValue, maxValue] are skipped */
+void kernel histogram(__global const T* in, ulong count, T minValue, T maxValue, uint binCount, __global uint* bins)
+{
+#if T_IS_FLOAT
+	T scale = (maxValue > minValue) ? (T)binCount / (maxValue - minValue) : (T)0;
+#else
+	/* unsigned differences don't overflow for any signed range, 64 bit integers stay exact */
+	ulong range = (ulong)maxValue - (ulong)minValue;
+	/* range * binCount would overflow, bins of range / binCount + 1 values instead */
+	bool wide = range > ULONG_MAX / binCount;
+	ulong binWidth = range / binCount + 1;
+#endif
+
+#if LOCAL_BINS > 0
+	__local uint hist[LOCAL_BINS];
+	for (uint i = get_local_id(0); i < binCount; i += get_local_size(0))
+		hist[i] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+#endif
+
+	for (ulong i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		T x = in[i];
+		if (x < minValue || x > maxValue)
+			continue;
+
+#if T_IS_FLOAT
+		uint bin = min((uint)((x - minValue) * scale), binCount - 1);
+#else
+		ulong diff = (ulong)x - (ulong)minValue;
+		ulong index = (range == 0) ? 0 : (wide ? diff / binWidth : diff * binCount / range);
+		uint bin = (uint)min(index, (ulong)(binCount - 1));
+#endif
+#if LOCAL_BINS > 0
+		atomic_inc(&hist[bin]);
+#else
+		atomic_inc(&bins[bin]);
+#endif
+	}
+
+#if LOCAL_BINS > 0
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (uint i = get_local_id(0); i < binCount; i += get_local_size(0))
+	{
+		if (hist[i] != 0)
+			atomic_add(&bins[i], hist[i]);
+	}
+#endif
+}
+
+void kernel compact_flags(__global const T* in, ulong count, __global uint* flags)
+{
+	ulong i = get_global_id(0);
+	if (i >= count)
+		return;
+
+	T x = in[i];
+	flags[i] = PREDICATE(x) ? 1 : 0;
+}
+
+void kernel compact_scatter(__global const T* in, ulong count, __global const uint* flags, __global const uint* positions, __global T* out, __global uint* total)
+{
+	ulong i = get_global_id(0);
+	if (i >= count)
+		return;
+
+	if (flags[i])
+		out[positions[i]] = in[i];
+
+	if (i == count - 1)
+		total[0] = positions[i] + flags[i];
+}
@@ -0,0 +1,101 @@
+#define KEY_TYPE %KEY_TYPE%
+#define VALUE_TYPE %VALUE_TYPE%
+#define HAS_VALUES %HAS_VALUES%
+#define WORK_GROUP_SIZE %WORK_GROUP_SIZE%
+#define RADIX_BITS 4
+#define RADIX 16
+
+/* inclusive Hillis-Steele scan over the work group, all work items have to call it */
+ulong scan_local(__local ulong* tmp, ulong value)
+{
+	uint lid = get_local_id(0);
+	tmp[lid] = value;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint offset = 1; offset < WORK_GROUP_SIZE; offset <<= 1)
+	{
+		ulong t = (lid >= offset) ? tmp[lid - offset] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		tmp[lid] += t;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	ulong result = tmp[lid];
+	barrier(CLK_LOCAL_MEM_FENCE);
+	return result;
+}
+
+/* counts the digits of every block, groupHist is stored digit major: [digit * groupCount + group] */
+void kernel radix_histogram(__global const KEY_TYPE* keys, ulong count, uint shift, __global uint* groupHist)
+{
+	__local uint hist[RADIX];
+
+	uint lid = get_local_id(0);
+	if (lid < RADIX)
+		hist[lid] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	ulong idx = get_global_id(0);
+	if (idx < count)
+		atomic_inc(&hist[(keys[idx] >> shift) & (RADIX - 1)]);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (lid < RADIX)
+		groupHist[lid * get_num_groups(0) + get_group_id(0)] = hist[lid];
+}
+
+/* exclusive scan of the whole histogram table inside a single work group */
+void kernel radix_scan(__global uint* groupHist, ulong count)
+{
+	__local ulong tmp[WORK_GROUP_SIZE];
+
+	ulong chunk = (count + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE;
+	ulong from = get_local_id(0) * chunk;
+	ulong to = min(from + chunk, count);
+
+	ulong sum = 0;
+	for (ulong i = from; i < to; i++)
+		sum += groupHist[i];
+
+	ulong offset = scan_local(tmp, sum) - sum;
+
+	for (ulong i = from; i < to; i++)
+	{
+		uint v = groupHist[i];
+		groupHist[i] = (uint)offset;
+		offset += v;
+	}
+}
+
+/* moves every key to its global position. The rank inside the block is computed with four scans over
+   16 bit lanes packed into ulong, which keeps the sort stable */
+void kernel radix_scatter(__global const KEY_TYPE* keysIn, __global const VALUE_TYPE* valuesIn, ulong count, uint shift, __global const uint* groupOffsets, __global KEY_TYPE* keysOut, __global VALUE_TYPE* valuesOut)
+{
+	__local ulong tmp[WORK_GROUP_SIZE];
+
+	ulong idx = get_global_id(0);
+	bool active = idx < count;
+	KEY_TYPE key = active ? keysIn[idx] : 0;
+	uint digit = (uint)((key >> shift) & (RADIX - 1));
+
+	uint rank = 0;
+	for (uint lane = 0; lane < RADIX / 4; lane++)
+	{
+		bool mine = active && (digit >> 2) == lane;
+		ulong flag = mine ? (1UL << (16 * (digit & 3))) : 0;
+		ulong inclusive = scan_local(tmp, flag);
+		if (mine)
+			rank = (uint)(((inclusive - flag) >> (16 * (digit & 3))) & 0xFFFF);
+	}
+
+	if (!active)
+		return;
+
+	uint pos = groupOffsets[digit * get_num_groups(0) + get_group_id(0)] + rank;
+	keysOut[pos] = key;
+#if HAS_VALUES
+	valuesOut[pos] = valuesIn[idx];
+#endif
+}
@@ -0,0 +1,90 @@
+#include "TpxPixel.clh"
+
+#define WORK_GROUP_SIZE %WORK_GROUP_SIZE%
+#define TOT_BINS 1024
+
+/* Transposes packed FTpxPixel records into separate aligned arrays.
+   The work group copies its records byte wise into local memory, so the global reads stay coalesced despite the packed 13 byte stride. */
+void kernel tpx_aos_to_soa(__global const uchar* hits, ulong hitCount, __global uchar* x, __global uchar* y, __global uchar* fToA, __global ulong* ToA, __global ushort* ToT)
+{
+	__local uchar staging[WORK_GROUP_SIZE * sizeof(FTpxPixel)];
+
+	ulong first = get_group_id(0) * WORK_GROUP_SIZE;
+	if (first >= hitCount)
+		return;
+
+	uint count = (hitCount - first < WORK_GROUP_SIZE) ? (uint)(hitCount - first) : WORK_GROUP_SIZE;
+	__global const uchar* src = hits + first * sizeof(FTpxPixel);
+
+	for (uint i = get_local_id(0); i < count * sizeof(FTpxPixel); i += WORK_GROUP_SIZE)
+		staging[i] = src[i];
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	uint lid = get_local_id(0);
+	if (lid >= count)
+		return;
+
+	__local const uchar* p = staging + lid * sizeof(FTpxPixel);
+	ulong toa = 0;
+	for (int b = 0; b < 8; b++)
+		toa |= ((ulong)p[3 + b]) << (8 * b);
+
+	ulong idx = first + lid;
+	x[idx] = p[0];
+	y[idx] = p[1];
+	fToA[idx] = p[2];
+	ToA[idx] = toa;
+	ToT[idx] = (ushort)(p[11] | (p[12] << 8));
+}
+
+void kernel tot_histogram_aos(__global const FTpxPixel* hits, ulong hitCount, __global uint* histogram)
+{
+	__local uint hist[TOT_BINS];
+
+	for (int i = get_local_id(0); i < TOT_BINS; i += get_local_size(0))
+		hist[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (ulong i = get_global_id(0); i < hitCount; i += get_global_size(0))
+		atomic_inc(&hist[min((uint)hits[i].ToT, (uint)(TOT_BINS - 1))]);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = get_local_id(0); i < TOT_BINS; i += get_local_size(0))
+	{
+		if (hist[i] != 0)
+			atomic_add(&histogram[i], hist[i]);
+	}
+}
+
+void kernel tot_histogram_soa(__global const ushort* ToT, ulong hitCount, __global uint* histogram)
+{
+	__local uint hist[TOT_BINS];
+
+	for (int i = get_local_id(0); i < TOT_BINS; i += get_local_size(0))
+		hist[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (ulong v = get_global_id(0); v < hitCount / 4; v += get_global_size(0))
+	{
+		uint4 tot = min(convert_uint4(vload4(v, ToT)), (uint4)(TOT_BINS - 1));
+		atomic_inc(&hist[tot.x]);
+		atomic_inc(&hist[tot.y]);
+		atomic_inc(&hist[tot.z]);
+		atomic_inc(&hist[tot.w]);
+	}
+
+	for (ulong i = (hitCount / 4) * 4 + get_global_id(0); i < hitCount; i += get_global_size(0))
+		atomic_inc(&hist[min((uint)ToT[i], (uint)(TOT_BINS - 1))]);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = get_local_id(0); i < TOT_BINS; i += get_local_size(0))
+	{
+		if (hist[i] != 0)
+			atomic_add(&histogram[i], hist[i]);
+	}
+}